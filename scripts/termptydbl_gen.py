@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+# generate src/bin/termptydbl_data.h, the east asian width table behind
+# _termpty_is_dblwidth_get()
+#
+#   scripts/termptydbl_gen.py [EastAsianWidth.txt] > src/bin/termptydbl_data.h
+#
+# without a file python's own unicodedata (built from the same file) is used.
+# every codepoint gets 2 bits: 1 for wide (W) or full-width (F), 2 for
+# ambiguous (A). they are kept in blocks of 256 codepoints, identical blocks
+# are shared and an index by codepoint >> 8 picks the block
+
+import sys
+
+MAX = 0x110000
+BLOCK = 256
+
+# codepoints the file doesn't list are N, except in these ranges where they
+# default to W
+DEFAULT_W = ((0x3400, 0x4dbf), (0x4e00, 0x9fff), (0xf900, 0xfaff),
+             (0x20000, 0x2fffd), (0x30000, 0x3fffd))
+
+def defaults():
+    val = [0] * MAX
+    for a, b in DEFAULT_W:
+        for c in range(a, b + 1):
+            val[c] = 1
+    return val
+
+def from_file(path):
+    val = defaults()
+    version = '?'
+    with open(path, encoding='utf-8') as f:
+        for line in f:
+            if line.startswith('# EastAsianWidth-'):
+                version = line[len('# EastAsianWidth-'):].split('.txt')[0]
+            line = line.split('#')[0].strip()
+            if not line:
+                continue
+            rng, prop = [s.strip() for s in line.split(';')]
+            if '..' in rng:
+                a, b = [int(s, 16) for s in rng.split('..')]
+            else:
+                a = b = int(rng, 16)
+            v = {'W': 1, 'F': 1, 'A': 2}.get(prop, 0)
+            for c in range(a, b + 1):
+                val[c] = v
+    return val, version
+
+def from_unicodedata():
+    import unicodedata
+    val = defaults()
+    for c in range(MAX):
+        # unassigned ones don't have a width of their own in unicodedata
+        if unicodedata.category(chr(c)) == 'Cn':
+            continue
+        val[c] = {'W': 1, 'F': 1, 'A': 2}.get(
+            unicodedata.east_asian_width(chr(c)), 0)
+    return val, unicodedata.unidata_version
+
+if len(sys.argv) > 1:
+    val, version = from_file(sys.argv[1])
+else:
+    val, version = from_unicodedata()
+
+blocks = []
+index = []
+for b in range(MAX // BLOCK):
+    words = []
+    for w in range(BLOCK // 16):
+        word = 0
+        for i in range(16):
+            word |= val[b * BLOCK + w * 16 + i] << (i * 2)
+        words.append(word)
+    words = tuple(words)
+    if words not in blocks:
+        blocks.append(words)
+    index.append(blocks.index(words))
+assert len(blocks) <= 256
+
+out = sys.stdout
+out.write('// generated by scripts/termptydbl_gen.py from Unicode %s\n'
+          '// EastAsianWidth data, do not edit\n\n' % version)
+out.write('#define TERMPTY_DBLWIDTH_BLOCKS %i\n\n' % len(blocks))
+out.write('const unsigned char _termpty_dblwidth_index[0x%x] =\n{\n'
+          % len(index))
+for i in range(0, len(index), 16):
+    out.write('   ' + ', '.join('%3i' % v for v in index[i:i + 16]) + ',\n')
+out.write('};\n\n')
+out.write('const unsigned int _termpty_dblwidth_bits'
+          '[TERMPTY_DBLWIDTH_BLOCKS][%i] =\n{\n' % (BLOCK // 16))
+for words in blocks:
+    out.write('     {\n')
+    for i in range(0, len(words), 4):
+        out.write('        ' +
+                  ', '.join('0x%08x' % w for w in words[i:i + 4]) + ',\n')
+    out.write('     },\n')
+out.write('};\n')
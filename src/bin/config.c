@@ -76,6 +76,10 @@ config_init(void)
      (edd_base, Config, "wordsep", wordsep, EET_T_STRING);
    EET_DATA_DESCRIPTOR_ADD_BASIC
      (edd_base, Config, "scrollback", scrollback, EET_T_INT);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "scrollback_mem", scrollback_mem, EET_T_INT);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "scrollback_disk", scrollback_disk, EET_T_UCHAR);
    EET_DATA_DESCRIPTOR_ADD_BASIC
      (edd_base, Config, "tab_zoom", tab_zoom, EET_T_DOUBLE);
    EET_DATA_DESCRIPTOR_ADD_BASIC
@@ -112,6 +116,8 @@ config_init(void)
      (edd_base, Config, "drag_links", drag_links, EET_T_UCHAR);
    EET_DATA_DESCRIPTOR_ADD_BASIC
      (edd_base, Config, "login_shell", login_shell, EET_T_UCHAR);
+   EET_DATA_DESCRIPTOR_ADD_BASIC
+     (edd_base, Config, "export_escapes", export_escapes, EET_T_UCHAR);
    EET_DATA_DESCRIPTOR_ADD_BASIC
      (edd_base, Config, "application_server", application_server, EET_T_UCHAR);
    EET_DATA_DESCRIPTOR_ADD_BASIC
@@ -194,6 +200,8 @@ config_sync(const Config *config_src, Config *config)
    eina_stringshare_replace(&(config->theme), config_src->theme);
    eina_stringshare_replace(&(config->wordsep), config_src->wordsep);
    config->scrollback = config_src->scrollback;
+   config->scrollback_mem = config_src->scrollback_mem;
+   config->scrollback_disk = config_src->scrollback_disk;
    config->tab_zoom = config_src->tab_zoom;
    config->vidmod = config_src->vidmod;
    config->jump_on_keypress = config_src->jump_on_keypress;
@@ -211,6 +219,7 @@ config_sync(const Config *config_src, Config *config)
    config->temporary = config_src->temporary;
    config->custom_geometry = config_src->custom_geometry;
    config->login_shell = config_src->login_shell;
+   config->export_escapes = config_src->export_escapes;
    config->cg_width = config_src->cg_width;
    config->cg_height = config_src->cg_height;
    config->colors_use = config_src->colors_use;
@@ -248,7 +257,10 @@ config_load(const char *key)
              else
                {
                   LIM(config->font.size, 3, 400);
-                  LIM(config->scrollback, 0, 200000);
+                  LIM(config->scrollback, 0, 10000000);
+                  if (config->scrollback_mem == 0)
+                    config->scrollback_mem = 256;
+                  LIM(config->scrollback_mem, 16, 4096);
                   if (config->tab_zoom == 0)
                     config->tab_zoom = 0.5;
                   LIM(config->tab_zoom, 0.1, 1.0);
@@ -450,6 +462,8 @@ config_load(const char *key)
              config->helper.local.image = eina_stringshare_add("xdg-open");
              config->helper.inline_please = EINA_TRUE;
              config->scrollback = 2000;
+             config->scrollback_mem = 256;
+             config->scrollback_disk = EINA_FALSE;
              config->tab_zoom = 0.5;
              config->theme = eina_stringshare_add("default.edj");
              config->background = NULL;
@@ -475,6 +489,7 @@ config_load(const char *key)
              config->erase_is_del = EINA_FALSE;
              config->custom_geometry = EINA_FALSE;
              config->login_shell = EINA_FALSE;
+             config->export_escapes = EINA_FALSE;
              config->cg_width = 80;
              config->cg_height = 24;
              config->colors_use = EINA_FALSE;
@@ -526,6 +541,8 @@ config_fork(Config *config)
    SCPY(background);
    SCPY(wordsep);
    CPY(scrollback);
+   CPY(scrollback_mem);
+   CPY(scrollback_disk);
    CPY(tab_zoom);
    CPY(vidmod);
    CPY(jump_on_change);
@@ -543,6 +560,7 @@ config_fork(Config *config)
    CPY(erase_is_del);
    CPY(custom_geometry);
    CPY(login_shell);
+   CPY(export_escapes);
    CPY(cg_width);
    CPY(cg_height);
    CPY(colors_use);
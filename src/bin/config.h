@@ -35,6 +35,8 @@ struct _Config
    const char       *background;
    const char       *wordsep;
    int               scrollback;
+   int               scrollback_mem; /* in MB, for all terminals together */
+   Eina_Bool         scrollback_disk; /* what doesn't fit goes to a file */
    double            tab_zoom;
    int               vidmod;
    Eina_Bool         jump_on_keypress;
@@ -53,6 +55,7 @@ struct _Config
    Eina_Bool         custom_geometry;
    Eina_Bool         drag_links;
    Eina_Bool         login_shell;
+   Eina_Bool         export_escapes; /* wt and we escapes may write files */
    int               cg_width;
    int               cg_height;
    Eina_Bool         colors_use;
@@ -9,6 +9,10 @@ static Ecore_Ipc_Server *ipc = NULL;
 static Ecore_Event_Handler *hnd_data = NULL;
 static void (*func_new_inst) (Ipc_Instance *inst) = NULL;
 static Eet_Data_Descriptor *new_inst_edd = NULL;
+static void (*func_search) (Ipc_Search *se) = NULL;
+static Eet_Data_Descriptor *search_edd = NULL;
+static void (*func_export) (Ipc_Export *ex) = NULL;
+static Eet_Data_Descriptor *export_edd = NULL;
 
 static Eina_Bool
 _ipc_cb_client_data(void *data EINA_UNUSED, int type EINA_UNUSED, void *event)
@@ -30,6 +34,28 @@ _ipc_cb_client_data(void *data EINA_UNUSED, int type EINA_UNUSED, void *event)
              free(inst);
           }
      }
+   else if ((e->major == 3) && (e->minor == 8) && (e->data) && (e->size > 0))
+     {
+        Ipc_Search *se;
+
+        se = eet_data_descriptor_decode(search_edd, e->data, e->size);
+        if (se)
+          {
+             if (func_search) func_search(se);
+             free(se);
+          }
+     }
+   else if ((e->major == 3) && (e->minor == 9) && (e->data) && (e->size > 0))
+     {
+        Ipc_Export *ex;
+
+        ex = eet_data_descriptor_decode(export_edd, e->data, e->size);
+        if (ex)
+          {
+             if (func_export) func_export(ex);
+             free(ex);
+          }
+     }
    return ECORE_CALLBACK_PASS_ON;
 }
 
@@ -127,6 +153,26 @@ ipc_init(void)
                                  "hold", hold, EET_T_INT);
    EET_DATA_DESCRIPTOR_ADD_BASIC(new_inst_edd, Ipc_Instance,
                                  "nowm", nowm, EET_T_INT);
+
+   eet_eina_stream_data_descriptor_class_set(&eddc, sizeof(eddc),
+                                             "search", sizeof(Ipc_Search));
+   search_edd = eet_data_descriptor_stream_new(&eddc);
+   EET_DATA_DESCRIPTOR_ADD_BASIC(search_edd, Ipc_Search,
+                                 "tty", tty, EET_T_STRING);
+   EET_DATA_DESCRIPTOR_ADD_BASIC(search_edd, Ipc_Search,
+                                 "str", str, EET_T_STRING);
+   EET_DATA_DESCRIPTOR_ADD_BASIC(search_edd, Ipc_Search,
+                                 "regex", regex, EET_T_INT);
+
+   eet_eina_stream_data_descriptor_class_set(&eddc, sizeof(eddc),
+                                             "export", sizeof(Ipc_Export));
+   export_edd = eet_data_descriptor_stream_new(&eddc);
+   EET_DATA_DESCRIPTOR_ADD_BASIC(export_edd, Ipc_Export,
+                                 "tty", tty, EET_T_STRING);
+   EET_DATA_DESCRIPTOR_ADD_BASIC(export_edd, Ipc_Export,
+                                 "path", path, EET_T_STRING);
+   EET_DATA_DESCRIPTOR_ADD_BASIC(export_edd, Ipc_Export,
+                                 "sgr", sgr, EET_T_INT);
 }
 
 Eina_Bool
@@ -155,6 +201,16 @@ ipc_shutdown(void)
         eet_data_descriptor_free(new_inst_edd);
         new_inst_edd = NULL;
      }
+   if (search_edd)
+     {
+        eet_data_descriptor_free(search_edd);
+        search_edd = NULL;
+     }
+   if (export_edd)
+     {
+        eet_data_descriptor_free(export_edd);
+        export_edd = NULL;
+     }
    eet_shutdown();
    ecore_ipc_shutdown();
    if (hnd_data)
@@ -170,32 +226,61 @@ ipc_instance_new_func_set(void (*func) (Ipc_Instance *inst))
    func_new_inst = func;
 }
 
-Eina_Bool
-ipc_instance_add(Ipc_Instance *inst)
+static Eina_Bool
+_ipc_send(int minor, Eet_Data_Descriptor *edd, void *msg)
 {
    int size = 0;
    void *data;
    char *hash = _ipc_hash_get();
    Ecore_Ipc_Server *ipcsrv;
-   
+
    if (!hash) return EINA_FALSE;
-   data = eet_data_descriptor_encode(new_inst_edd, inst, &size);
+   data = eet_data_descriptor_encode(edd, msg, &size);
    if (!data)
      {
         free(hash);
         return EINA_FALSE;
      }
    ipcsrv = ecore_ipc_server_connect(ECORE_IPC_LOCAL_USER, hash, 0, NULL);
-   if (ipcsrv)
+   free(hash);
+   if (!ipcsrv)
      {
-        ecore_ipc_server_send(ipcsrv, 3, 7, 0, 0, 0, data, size);
-        ecore_ipc_server_flush(ipcsrv);
         free(data);
-        free(hash);
-        ecore_ipc_server_del(ipcsrv);
-        return EINA_TRUE;
+        return EINA_FALSE;
      }
+   ecore_ipc_server_send(ipcsrv, 3, minor, 0, 0, 0, data, size);
+   ecore_ipc_server_flush(ipcsrv);
    free(data);
-   free(hash);
-   return EINA_FALSE;
+   ecore_ipc_server_del(ipcsrv);
+   return EINA_TRUE;
+}
+
+Eina_Bool
+ipc_instance_add(Ipc_Instance *inst)
+{
+   return _ipc_send(7, new_inst_edd, inst);
+}
+
+void
+ipc_search_func_set(void (*func) (Ipc_Search *se))
+{
+   func_search = func;
+}
+
+Eina_Bool
+ipc_search(Ipc_Search *se)
+{
+   return _ipc_send(8, search_edd, se);
+}
+
+void
+ipc_export_func_set(void (*func) (Ipc_Export *ex))
+{
+   func_export = func;
+}
+
+Eina_Bool
+ipc_export(Ipc_Export *ex)
+{
+   return _ipc_send(9, export_edd, ex);
 }
@@ -29,10 +29,35 @@ struct _Ipc_Instance
    int xterm_256color;
 };
 
+typedef struct _Ipc_Search Ipc_Search;
+
+// a scrollback search in the terminal on tty, like ESC } sf / sr do
+struct _Ipc_Search
+{
+   const char *tty;
+   const char *str;
+   int regex;
+};
+
+typedef struct _Ipc_Export Ipc_Export;
+
+// an export of the scrollback and screen of the terminal on tty to path,
+// like the key binding does
+struct _Ipc_Export
+{
+   const char *tty;
+   const char *path;
+   int sgr;
+};
+
 void ipc_init(void);
 void ipc_shutdown(void);
 Eina_Bool ipc_serve(void);
 void ipc_instance_new_func_set(void (*func) (Ipc_Instance *inst));
 Eina_Bool ipc_instance_add(Ipc_Instance *inst);
+void ipc_search_func_set(void (*func) (Ipc_Search *se));
+Eina_Bool ipc_search(Ipc_Search *se);
+void ipc_export_func_set(void (*func) (Ipc_Export *ex));
+Eina_Bool ipc_export(Ipc_Export *ex);
 
 #endif
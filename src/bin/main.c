@@ -2535,6 +2535,61 @@ main_ipc_new(Ipc_Instance *inst)
    free(nargv);
 }
 
+// the term whose pty slave is tty, for requests run from inside one
+static Term *
+_main_term_tty_find(const char *tty)
+{
+   Eina_List *l, *ll;
+   Win *wn;
+   Term *term;
+
+   if (!tty) return NULL;
+   EINA_LIST_FOREACH(wins, l, wn)
+     {
+        EINA_LIST_FOREACH(wn->terms, ll, term)
+          {
+             Termpty *ty = termio_pty_get(term->term);
+             const char *name;
+
+             if ((!ty) || (ty->fd < 0)) continue;
+             name = ptsname(ty->fd);
+             if ((name) && (!strcmp(name, tty))) return term;
+          }
+     }
+   return NULL;
+}
+
+static void
+main_ipc_search(Ipc_Search *se)
+{
+   Term *term;
+
+   if (!se->str) return;
+   term = _main_term_tty_find(se->tty);
+   if (!term)
+     {
+        ERR("search: no terminal on %s", se->tty ? se->tty : "(none)");
+        return;
+     }
+   termio_search(term->term, se->str, !!se->regex);
+}
+
+static void
+main_ipc_export(Ipc_Export *ex)
+{
+   Term *term;
+
+   if (!ex->path) return;
+   term = _main_term_tty_find(ex->tty);
+   if (!term)
+     {
+        ERR("export: no terminal on %s", ex->tty ? ex->tty : "(none)");
+        return;
+     }
+   if (!termio_export(term->term, ex->path, !!ex->sgr))
+     ERR("export: could not export scrollback to %s", ex->path);
+}
+
 static const char *emotion_choices[] = {
   "auto", "gstreamer", "xine", "generic",
   NULL
@@ -2602,6 +2657,14 @@ static const Ecore_Getopt options = {
                               "Force single executable if multi-instance is enabled.."),
       ECORE_GETOPT_STORE_TRUE('2', "256color",
                               "Set TERM to 'xterm-256color' instead of 'xterm'."),
+      ECORE_GETOPT_STORE_STR (0, "search",
+                              "Search the scrollback of the terminology this is run in for TEXT."),
+      ECORE_GETOPT_STORE_STR (0, "search-regex",
+                              "Search the scrollback of the terminology this is run in for REGEX."),
+      ECORE_GETOPT_STORE_STR (0, "export",
+                              "Write the scrollback and screen of the terminology this is run in to FILE."),
+      ECORE_GETOPT_STORE_TRUE(0, "export-escapes",
+                              "Keep colors and such as escapes in what --export writes."),
 
       ECORE_GETOPT_VERSION   ('V', "version"),
       ECORE_GETOPT_COPYRIGHT ('C', "copyright"),
@@ -2625,6 +2688,9 @@ elm_main(int argc, char **argv)
    char *icon_name = NULL;
    char *font = NULL;
    char *video_module = NULL;
+   char *search = NULL;
+   char *search_regex = NULL;
+   char *export = NULL;
    Eina_Bool login_shell = 0xff; /* unset */
    Eina_Bool video_mute = 0xff; /* unset */
    Eina_Bool cursor_blink = 0xff; /* unset */
@@ -2642,6 +2708,7 @@ elm_main(int argc, char **argv)
    Eina_Bool cmd_options = EINA_FALSE;
 #endif
    Eina_Bool xterm_256color = EINA_FALSE;
+   Eina_Bool export_escapes = EINA_FALSE;
    Ecore_Getopt_Value values[] = {
 #if (ECORE_VERSION_MAJOR > 1) || (ECORE_VERSION_MINOR >= 8)
      ECORE_GETOPT_VALUE_BOOL(cmd_options),
@@ -2672,6 +2739,10 @@ elm_main(int argc, char **argv)
      ECORE_GETOPT_VALUE_BOOL(hold),
      ECORE_GETOPT_VALUE_BOOL(single),
      ECORE_GETOPT_VALUE_BOOL(xterm_256color),
+     ECORE_GETOPT_VALUE_STR(search),
+     ECORE_GETOPT_VALUE_STR(search_regex),
+     ECORE_GETOPT_VALUE_STR(export),
+     ECORE_GETOPT_VALUE_BOOL(export_escapes),
 
      ECORE_GETOPT_VALUE_BOOL(quit_option),
      ECORE_GETOPT_VALUE_BOOL(quit_option),
@@ -2932,6 +3003,48 @@ elm_main(int argc, char **argv)
      }
    login_shell = config->login_shell;
 
+   // a search or export is handed to the running terminology that owns our
+   // tty and never opens a window of its own
+   if (export)
+     {
+        Ipc_Export ex;
+        char pathbuf[PATH_MAX], cwdbuf[4096];
+
+        memset(&ex, 0, sizeof(Ipc_Export));
+        ex.tty = ttyname(0);
+        ex.path = export;
+        // the server has a cwd of its own
+        if ((export[0] != '/') && (getcwd(cwdbuf, sizeof(cwdbuf))))
+          {
+             snprintf(pathbuf, sizeof(pathbuf), "%s/%s", cwdbuf, export);
+             ex.path = pathbuf;
+          }
+        ex.sgr = export_escapes;
+        if ((!config->multi_instance) || (!ex.tty) || (!ipc_export(&ex)))
+          {
+             fprintf(stderr, "ERROR: no multi-instance terminology owns this tty.\n");
+             retval = EXIT_FAILURE;
+          }
+        config_del(config);
+        goto end;
+     }
+   if ((search) || (search_regex))
+     {
+        Ipc_Search se;
+
+        memset(&se, 0, sizeof(Ipc_Search));
+        se.tty = ttyname(0);
+        se.str = search ? search : search_regex;
+        se.regex = !search;
+        if ((!config->multi_instance) || (!se.tty) || (!ipc_search(&se)))
+          {
+             fprintf(stderr, "ERROR: no multi-instance terminology owns this tty.\n");
+             retval = EXIT_FAILURE;
+          }
+        config_del(config);
+        goto end;
+     }
+
 remote:
    if ((!single) && (config->multi_instance))
      {
@@ -2969,6 +3082,8 @@ remote:
    if ((!single) && (config->multi_instance))
      {
         ipc_instance_new_func_set(main_ipc_new);
+        ipc_search_func_set(main_ipc_search);
+        ipc_export_func_set(main_ipc_export);
         if (!ipc_serve())
           {
              if (remote_try < 1)
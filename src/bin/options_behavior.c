@@ -7,7 +7,7 @@
 #include "options_behavior.h"
 #include "main.h"
 
-static Evas_Object *op_w, *op_h;
+static Evas_Object *op_w, *op_h, *op_sback;
 
 static void
 _cb_op_behavior_drag_links_chg(void *data, Evas_Object *obj, void *event EINA_UNUSED)
@@ -196,6 +196,31 @@ _cb_op_behavior_sback_chg(void *data, Evas_Object *obj, void *event EINA_UNUSED)
    config_save(config, NULL);
 }
 
+static void
+_cb_op_behavior_sback_mem_chg(void *data, Evas_Object *obj, void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+
+   config->scrollback_mem = elm_slider_value_get(obj) + 0.5;
+   termio_config_update(term);
+   config_save(config, NULL);
+}
+
+static void
+_cb_op_behavior_sback_disk_chg(void *data, Evas_Object *obj, void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+
+   config->scrollback_disk = elm_check_state_get(obj);
+   // on disk there's room for a lot more
+   elm_slider_min_max_set(op_sback, 0,
+                          config->scrollback_disk ? 1000000 : 10000);
+   termio_config_update(term);
+   config_save(config, NULL);
+}
+
 static void
 _cb_op_behavior_tab_zoom_slider_chg(void *data, Evas_Object *obj,
                                     void *event EINA_UNUSED)
@@ -261,6 +286,15 @@ _cb_op_behavior_login_shell_chg(void *data, Evas_Object *obj, void *event EINA_U
    config_save(config, NULL);
 }
 
+static void
+_cb_op_behavior_export_escapes_chg(void *data, Evas_Object *obj, void *event EINA_UNUSED)
+{
+   Evas_Object *term = data;
+   Config *config = termio_config_get(term);
+   config->export_escapes = elm_check_state_get(obj);
+   config_save(config, NULL);
+}
+
 void
 options_behavior(Evas_Object *opbox, Evas_Object *term)
 {
@@ -415,6 +449,16 @@ options_behavior(Evas_Object *opbox, Evas_Object *term)
    evas_object_smart_callback_add(o, "changed",
                                   _cb_op_behavior_login_shell_chg, term);
 
+   o = elm_check_add(bx);
+   evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
+   evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.5);
+   elm_object_text_set(o, "Let programs write the scrollback to a file");
+   elm_check_state_set(o, config->export_escapes);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+   evas_object_smart_callback_add(o, "changed",
+                                  _cb_op_behavior_export_escapes_chg, term);
+
    o = elm_check_add(bx);
    evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
    evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.5);
@@ -508,19 +552,49 @@ options_behavior(Evas_Object *opbox, Evas_Object *term)
    elm_box_pack_end(bx, o);
    evas_object_show(o);
 
-   o = elm_slider_add(bx);
+   op_sback = o = elm_slider_add(bx);
    evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
    evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.0);
    elm_slider_span_size_set(o, 40);
    elm_slider_unit_format_set(o, "%1.0f");
    elm_slider_indicator_format_set(o, "%1.0f");
-   elm_slider_min_max_set(o, 0, 10000);
+   elm_slider_min_max_set(o, 0, config->scrollback_disk ? 1000000 : 10000);
    elm_slider_value_set(o, config->scrollback);
    elm_box_pack_end(bx, o);
    evas_object_show(o);
    evas_object_smart_callback_add(o, "delay,changed",
                                   _cb_op_behavior_sback_chg, term);
 
+   o = elm_label_add(bx);
+   evas_object_size_hint_weight_set(o, 0.0, 0.0);
+   evas_object_size_hint_align_set(o, 0.0, 0.5);
+   elm_object_text_set(o, "Scrollback memory of all terminals:");
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+
+   o = elm_slider_add(bx);
+   evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
+   evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.0);
+   elm_slider_span_size_set(o, 40);
+   elm_slider_unit_format_set(o, "%1.0f MB");
+   elm_slider_indicator_format_set(o, "%1.0f");
+   elm_slider_min_max_set(o, 16, 4096);
+   elm_slider_value_set(o, config->scrollback_mem);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+   evas_object_smart_callback_add(o, "delay,changed",
+                                  _cb_op_behavior_sback_mem_chg, term);
+
+   o = elm_check_add(bx);
+   evas_object_size_hint_weight_set(o, EVAS_HINT_EXPAND, 0.0);
+   evas_object_size_hint_align_set(o, EVAS_HINT_FILL, 0.5);
+   elm_object_text_set(o, "Keep scrollback beyond that on disk");
+   elm_check_state_set(o, config->scrollback_disk);
+   elm_box_pack_end(bx, o);
+   evas_object_show(o);
+   evas_object_smart_callback_add(o, "changed",
+                                  _cb_op_behavior_sback_disk_chg, term);
+
    o = elm_label_add(bx);
    evas_object_size_hint_weight_set(o, 0.0, 0.0);
    evas_object_size_hint_align_set(o, 0.0, 0.5);
@@ -11,14 +11,18 @@
 #include "termcmd.h"
 
 static Eina_Bool
-_termcmd_search(Evas_Object *obj EINA_UNUSED, Evas_Object *win EINA_UNUSED, Evas_Object *bg EINA_UNUSED, const char *cmd)
+_termcmd_search(Evas_Object *obj, Evas_Object *win EINA_UNUSED, Evas_Object *bg EINA_UNUSED, const char *cmd, Eina_Bool regex)
 {
-   if (cmd[0] == 0) // clear search
-     {
-        printf("search clear\n");
-        return EINA_TRUE;
-     }
-   printf("search '%s'\n", cmd);
+   // an empty one clears the search
+   termio_search(obj, cmd, regex);
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_termcmd_export(Evas_Object *obj, Evas_Object *win EINA_UNUSED, Evas_Object *bg EINA_UNUSED, const char *cmd, Eina_Bool sgr)
+{
+   // with no path termio picks a new file in the home directory
+   termio_export(obj, cmd, sgr);
    return EINA_TRUE;
 }
 
@@ -126,7 +130,9 @@ termcmd_watch(Evas_Object *obj, Evas_Object *win, Evas_Object *bg, const char *c
 {
    if (!cmd) return EINA_FALSE;
    if ((cmd[0] == '/') || (cmd[0] == 's'))
-     return _termcmd_search(obj, win, bg, cmd + 1);
+     return _termcmd_search(obj, win, bg, cmd + 1, EINA_FALSE);
+   if (cmd[0] == 'r')
+     return _termcmd_search(obj, win, bg, cmd + 1, EINA_TRUE);
    return EINA_FALSE;
 }
 
@@ -136,13 +142,17 @@ termcmd_do(Evas_Object *obj, Evas_Object *win, Evas_Object *bg, const char *cmd)
 {
    if (!cmd || !cmd[0]) return EINA_FALSE;
    if ((cmd[0] == '/') || (cmd[0] == 's'))
-     return _termcmd_search(obj, win, bg, cmd + 1);
+     return _termcmd_search(obj, win, bg, cmd + 1, EINA_FALSE);
+   if (cmd[0] == 'r')
+     return _termcmd_search(obj, win, bg, cmd + 1, EINA_TRUE);
    if ((cmd[0] == 'f') || (cmd[0] == 'F'))
      return _termcmd_font_size(obj, win, bg, cmd + 1);
    if ((cmd[0] == 'g') || (cmd[0] == 'G'))
      return _termcmd_grid_size(obj, win, bg, cmd + 1);
    if ((cmd[0] == 'b') || (cmd[0] == 'B'))
      return _termcmd_background(obj, win, bg, cmd + 1);
+   if ((cmd[0] == 'w') || (cmd[0] == 'W'))
+     return _termcmd_export(obj, win, bg, cmd + 1, cmd[0] == 'W');
 
    ERR("Unknown command: %s", cmd);
    return EINA_FALSE;
@@ -5,7 +5,10 @@
 #include <Ecore_Input.h>
 #include "termio.h"
 #include "termiolink.h"
+#include "termioexport.h"
 #include "termpty.h"
+#include "termptysave.h"
+#include "termptysearch.h"
 #include "termcmd.h"
 #include "utf8.h"
 #include "col.h"
@@ -15,6 +18,19 @@
 #include "media.h"
 #include "dbus.h"
 
+// seconds the size has to stay the same before the pty follows the view
+#define RESIZE_SETTLE 0.2
+// rows the link index looks at per idler call
+#define LINK_INDEX_ROWS 8
+// rows of text a search goes through per go, the rest is left to an idler
+#define SEARCH_ROWS 512
+// selections of more rows than this are copied from an idler, this many
+// bytes of text at a time
+#define SEL_COPY_ROWS 1000
+#define SEL_COPY_BYTES (256 * 1024)
+// longest sgr escape selection text can have, and its nul
+#define SGR_MAX 48
+
 typedef struct _Termio Termio;
 
 struct _Termio
@@ -46,6 +62,8 @@ struct _Termio
       int suspend;
       Eina_List *objs;
       Evas_Object *ctxpopup;
+      Termlinkindex *index; // links on the rows of the view (termiolink.c)
+      Ecore_Idler *index_idler;
       struct {
          Evas_Object *dndobj;
          Evas_Coord x, y;
@@ -54,8 +72,32 @@ struct _Termio
          Eina_Bool dndobjdel : 1;
       } down;
    } link;
+   // scrollback search going on (see termptysearch.c), its match is shown
+   // as the selection
+   struct {
+      Termsearch *se;
+      Ecore_Idler *idler;
+      Eina_Bool up : 1;
+      Eina_Bool sel : 1; // the selection is the match
+   } search;
+   // scrollback being written to a file (see termioexport.c)
+   struct {
+      Termexport *ex;
+      Eina_Bool reply : 1; // write where it went to the pty when done
+   } export;
    int zoom_fontsize_start;
    int scroll;
+   // view state the textgrid was last filled with - see _smart_apply()
+   struct {
+      int scroll;
+      Eina_Bool inv : 1;
+   } drawn;
+   // screen scrolls since the last _smart_apply(), if they were all the
+   // same region in the same direction
+   struct {
+      int start_y, end_y, n;
+      Eina_Bool mixed : 1;
+   } scrolled;
    unsigned int last_keyup;
    Eina_List *mirrors;
    Eina_List *seq;
@@ -64,6 +106,7 @@ struct _Termio
    Termpty *pty;
    Ecore_Animator *anim;
    Ecore_Timer *delayed_size_timer;
+   Ecore_Timer *resize_settle_timer;
    Ecore_Timer *link_do_timer;
    Ecore_Timer *mouse_selection_scroll;
    Ecore_Job *mouse_move_job;
@@ -71,7 +114,15 @@ struct _Termio
    Evas_Object *win, *theme, *glayer;
    Config *config;
    Ecore_IMF_Context *imf;
-   const char *sel_str;
+   char *sel_str; // text of the selection we own
+   size_t sel_len;
+   // a selection too big to copy in one go being read into sb
+   struct {
+      Termselread *sr;
+      Ecore_Idler *idler;
+      Eina_Strbuf *sb;
+      Elm_Sel_Type type;
+   } sel_copy;
    Eina_List *cur_chids;
    Ecore_Job *sel_reset_job;
    double set_sel_at;
@@ -98,6 +149,7 @@ static void _smart_calculate(Evas_Object *obj);
 static void _smart_mirror_del(void *data, Evas *evas EINA_UNUSED, Evas_Object *obj, void *info EINA_UNUSED);
 static void _lost_selection(void *data, Elm_Sel_Type selection);
 static void _take_selection_text(Evas_Object *obj, Elm_Sel_Type type, const char *text);
+static char *_selection_text_get(Evas_Object *obj, int c1x, int c1y, int c2x, int c2y, Eina_Bool box, size_t *len);
 
 static void
 _sel_set(Evas_Object *obj, Eina_Bool enable)
@@ -662,8 +714,9 @@ _smart_mouseover_apply(Evas_Object *obj)
         return;
      }
 
-   s = _termio_link_find(obj, sd->mouse.cx, sd->mouse.cy,
-                         &x1, &y1, &x2, &y2);
+   s = _termio_link_index_find(sd->link.index, obj,
+                               sd->mouse.cx, sd->mouse.cy,
+                               &x1, &y1, &x2, &y2);
    if (!s)
      {
         _remove_links(sd, obj);
@@ -1279,6 +1332,58 @@ _block_activate(Evas_Object *obj, Termblock *blk)
      sd->pty->block.active = eina_list_append(sd->pty->block.active, blk);
 }
 
+// returns the first textgrid row that has to be redrawn whether the pty
+// says it's dirty or not, grid.h if there's none
+static int
+_smart_rows_shift(Termio *sd, int y1, int y2, int n)
+{
+   Evas_Textgrid_Cell *src, *dst;
+   int y, redo = sd->grid.h;
+
+   // textgrid has no way to scroll so move the cells ourselves. still
+   // beats redoing colors for every cell, and rows that end up the same
+   // (blank ones mostly) don't even need an update
+   _termio_link_index_shift(sd->link.index, y1, y2, n);
+   // while a resize settles the textgrid can be shorter than the pty. rows
+   // scrolled up from below its bottom aren't in it to move, and their
+   // dirty flags moved with them, so those rows have to be redone
+   if (y2 >= sd->grid.h)
+     {
+        y2 = sd->grid.h - 1;
+        if (n < 0) redo = y2 + n + 1;
+     }
+   if ((y1 < 0) || (abs(n) > (y2 - y1)))
+     return (y1 < 0) ? 0 : y1;
+   if (redo < y1) redo = y1;
+   for (y = 0; y <= (y2 - y1 - abs(n)); y++)
+     {
+        int yd = (n < 0) ? (y1 + y) : (y2 - y);
+
+        src = evas_object_textgrid_cellrow_get(sd->grid.obj, yd - n);
+        dst = evas_object_textgrid_cellrow_get(sd->grid.obj, yd);
+        if ((!src) || (!dst)) continue;
+        if (!memcmp(dst, src, sd->grid.w * sizeof(Evas_Textgrid_Cell)))
+          continue;
+        memcpy(dst, src, sd->grid.w * sizeof(Evas_Textgrid_Cell));
+        evas_object_textgrid_cellrow_set(sd->grid.obj, yd, dst);
+        evas_object_textgrid_update_add(sd->grid.obj, 0, yd, sd->grid.w, 1);
+     }
+   return redo;
+}
+
+static Eina_Bool
+_smart_cb_link_index(void *data)
+{
+   Evas_Object *obj = data;
+   Termio *sd = evas_object_smart_data_get(obj);
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(sd, EINA_FALSE);
+   if (_termio_link_index_run(sd->link.index, obj, LINK_INDEX_ROWS))
+     return EINA_TRUE;
+   sd->link.index_idler = NULL;
+   return EINA_FALSE;
+}
+
 static void
 _smart_apply(Evas_Object *obj)
 {
@@ -1286,23 +1391,46 @@ _smart_apply(Evas_Object *obj)
    Evas_Coord ox, oy, ow, oh;
    Eina_List *l, *ln;
    Termblock *blk;
-   int j, x, y, w, ch1 = 0, ch2 = 0, inv = 0;
+   int j, x, y, w, ch1 = 0, ch2 = 0, inv = 0, redo;
+   Eina_Bool full;
 
    EINA_SAFETY_ON_NULL_RETURN(sd);
    evas_object_geometry_get(obj, &ox, &oy, &ow, &oh);
    
+   inv = sd->pty->state.reverse;
+   // only rows the pty marked dirty need comparing against the textgrid,
+   // unless the view scrolled, the whole screen's colors flipped or there
+   // are blocks that need positioning every time
+   full = ((sd->scroll != sd->drawn.scroll) || (inv != sd->drawn.inv) ||
+           (sd->pty->block.active) || (sd->debugwhite));
+   // the pty's dirty rows already moved with its scrolls, so if the
+   // textgrid rows move the same way only the ones scrolled in are left
+   redo = sd->grid.h;
+   if ((sd->scrolled.n != 0) || (sd->scrolled.mixed))
+     {
+        if ((sd->scrolled.mixed) || (sd->scroll != 0)) full = EINA_TRUE;
+        else if (!full)
+          redo = _smart_rows_shift(sd, sd->scrolled.start_y,
+                                   sd->scrolled.end_y, sd->scrolled.n);
+        sd->scrolled.n = 0;
+        sd->scrolled.mixed = EINA_FALSE;
+     }
    EINA_LIST_FOREACH(sd->pty->block.active, l, blk)
      {
         blk->was_active = blk->active;
         blk->active = EINA_FALSE;
      }
-   inv = sd->pty->state.reverse;
+   if (full) _termio_link_index_dirty(sd->link.index, -1);
    termpty_cellcomp_freeze(sd->pty);
    for (y = 0; y < sd->grid.h; y++)
      {
         Termcell *cells;
         Evas_Textgrid_Cell *tc;
 
+        if ((!full) && (y < redo) &&
+            (!termpty_dirty_row_get(sd->pty, y - sd->scroll)))
+          continue;
+        if (!full) _termio_link_index_dirty(sd->link.index, y);
         w = 0; j = 0;
         cells = termpty_cellrow_get(sd->pty, y - sd->scroll, &w);
         tc = evas_object_textgrid_cellrow_get(sd->grid.obj, y);
@@ -1504,6 +1632,11 @@ _smart_apply(Evas_Object *obj)
                                           ch2 - ch1 + 1, 1);
      }
    termpty_cellcomp_thaw(sd->pty);
+   termpty_dirty_clear(sd->pty);
+   if (!sd->link.index_idler)
+     sd->link.index_idler = ecore_idler_add(_smart_cb_link_index, obj);
+   sd->drawn.scroll = sd->scroll;
+   sd->drawn.inv = inv;
    
    EINA_LIST_FOREACH_SAFE(sd->pty->block.active, l, ln, blk)
      {
@@ -1626,6 +1759,26 @@ _smart_apply(Evas_Object *obj)
    sd->mouseover_delay = ecore_timer_add(0.05, _smart_mouseover_delay, obj);
 }
 
+static Eina_Bool
+_smart_cb_resize_settle(void *data)
+{
+   Evas_Object *obj = data;
+   Termio *sd = evas_object_smart_data_get(obj);
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(sd, EINA_FALSE);
+   sd->resize_settle_timer = NULL;
+   if ((sd->pty->w == sd->grid.w) && (sd->pty->h == sd->grid.h))
+     return EINA_FALSE;
+   evas_event_freeze(evas_object_evas_get(obj));
+   _sel_set(obj, EINA_FALSE);
+   termpty_resize(sd->pty, sd->grid.w, sd->grid.h);
+   termpty_dirty_all(sd->pty);
+   _smart_calculate(obj);
+   _smart_apply(obj);
+   evas_event_thaw(evas_object_evas_get(obj));
+   return EINA_FALSE;
+}
+
 static void
 _smart_size(Evas_Object *obj, int w, int h, Eina_Bool force)
 {
@@ -1643,6 +1796,7 @@ _smart_size(Evas_Object *obj, int w, int h, Eina_Bool force)
    evas_object_textgrid_size_set(sd->grid.obj, w, h);
    sd->grid.w = w;
    sd->grid.h = h;
+   _termio_link_index_resize(sd->link.index, h);
    evas_object_resize(sd->cursor.obj, sd->font.chw, sd->font.chh);
    evas_object_size_hint_min_set(obj, sd->font.chw, sd->font.chh);
    if (!sd->noreqsize)
@@ -1650,7 +1804,22 @@ _smart_size(Evas_Object *obj, int w, int h, Eina_Bool force)
                                        sd->font.chw * sd->grid.w,
                                        sd->font.chh * sd->grid.h);
    _sel_set(obj, EINA_FALSE);
-   termpty_resize(sd->pty, w, h);
+   // while the size keeps changing (dragging a window edge) only the view
+   // follows it, showing the pty clipped or padded. the pty is rewrapped and
+   // the child gets its SIGWINCH once, for the size it settles on, unless
+   // the size has to be right away
+   if (force)
+     {
+        termpty_resize(sd->pty, w, h);
+        if (sd->resize_settle_timer)
+          ecore_timer_del(sd->resize_settle_timer);
+        sd->resize_settle_timer = NULL;
+     }
+   else if (!sd->resize_settle_timer)
+     sd->resize_settle_timer = ecore_timer_add(RESIZE_SETTLE,
+                                               _smart_cb_resize_settle, obj);
+   else ecore_timer_reset(sd->resize_settle_timer);
+   termpty_dirty_all(sd->pty);
    _smart_calculate(obj);
    _smart_apply(obj);
    evas_event_thaw(evas_object_evas_get(obj));
@@ -1704,7 +1873,7 @@ _lost_selection_reset_job(void *data)
    sd->sel_reset_job = NULL;
    elm_cnp_selection_set(sd->win, sd->sel_type,
                          ELM_SEL_FORMAT_TEXT,
-                         sd->sel_str, strlen(sd->sel_str));
+                         sd->sel_str, sd->sel_len);
    elm_cnp_selection_loss_callback_set(sd->win, sd->sel_type,
                                        _lost_selection, data);
 }
@@ -1732,11 +1901,8 @@ _lost_selection(void *data, Elm_Sel_Type selection)
           }
         if (sd->have_sel)
           {
-             if (sd->sel_str)
-               {
-                  eina_stringshare_del(sd->sel_str);
-                  sd->sel_str = NULL;
-               }
+             free(sd->sel_str);
+             sd->sel_str = NULL;
              _sel_set(obj, EINA_FALSE);
              elm_object_cnp_selection_clear(sd->win, selection);
              _smart_update_queue(obj, sd);
@@ -1745,28 +1911,85 @@ _lost_selection(void *data, Elm_Sel_Type selection)
      }
 }
 
+// takes text, a malloc'ed string of len bytes, as the selection
 static void
-_take_selection_text(Evas_Object *obj, Elm_Sel_Type type, const char *text)
+_take_selection_own(Evas_Object *obj, Elm_Sel_Type type, char *text,
+                    size_t len)
 {
    Termio *sd = evas_object_smart_data_get(obj);
 
-   EINA_SAFETY_ON_NULL_RETURN(sd);
-
-   text = eina_stringshare_add(text);
-
+   if (!sd)
+     {
+        free(text);
+        return;
+     }
    sd->have_sel = EINA_FALSE;
    sd->reset_sel = EINA_FALSE;
    sd->set_sel_at = ecore_time_get(); // hack
    sd->sel_type = type;
    elm_cnp_selection_set(sd->win, type,
                          ELM_SEL_FORMAT_TEXT,
-                         text,
-                         eina_stringshare_strlen(text));
+                         text, len);
    elm_cnp_selection_loss_callback_set(sd->win, type,
                                        _lost_selection, obj);
    sd->have_sel = EINA_TRUE;
-   if (sd->sel_str) eina_stringshare_del(sd->sel_str);
+   free(sd->sel_str);
    sd->sel_str = text;
+   sd->sel_len = len;
+}
+
+static void
+_take_selection_text(Evas_Object *obj, Elm_Sel_Type type, const char *text)
+{
+   char *s = strdup(text);
+
+   if (s) _take_selection_own(obj, type, s, strlen(s));
+}
+
+static void
+_sel_copy_stop(Termio *sd)
+{
+   if (sd->sel_copy.idler) ecore_idler_del(sd->sel_copy.idler);
+   sd->sel_copy.idler = NULL;
+   termio_selection_read_free(sd->sel_copy.sr);
+   sd->sel_copy.sr = NULL;
+   if (sd->sel_copy.sb) eina_strbuf_free(sd->sel_copy.sb);
+   sd->sel_copy.sb = NULL;
+}
+
+static Eina_Bool
+_smart_cb_sel_copy(void *data)
+{
+   Evas_Object *obj = data;
+   Termio *sd = evas_object_smart_data_get(obj);
+   char page[16384];
+   ssize_t n = 0;
+   size_t done = 0, len;
+   char *s;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(sd, EINA_FALSE);
+   while (done < SEL_COPY_BYTES)
+     {
+        n = termio_selection_read(sd->sel_copy.sr, page, sizeof(page));
+        if (n <= 0) break;
+        eina_strbuf_append_length(sd->sel_copy.sb, page, n);
+        done += n;
+     }
+   if (n > 0) return EINA_TRUE;
+   sd->sel_copy.idler = NULL;
+   if (n < 0)
+     {
+        ERR("selection went away while being copied");
+        _sel_copy_stop(sd);
+        return EINA_FALSE;
+     }
+   len = eina_strbuf_length_get(sd->sel_copy.sb);
+   s = eina_strbuf_string_steal(sd->sel_copy.sb);
+   if ((sd->win) && (len > 0))
+     _take_selection_own(obj, sd->sel_copy.type, s, len);
+   else free(s);
+   _sel_copy_stop(sd);
+   return EINA_FALSE;
 }
 
 static void
@@ -1776,8 +1999,11 @@ _take_selection(Evas_Object *obj, Elm_Sel_Type type)
    int start_x = 0, start_y = 0, end_x = 0, end_y = 0;
    char *s = NULL;
    size_t len = 0;
+   Eina_Bool box;
 
    EINA_SAFETY_ON_NULL_RETURN(sd);
+   // this one replaces one still being copied
+   _sel_copy_stop(sd);
    if (sd->pty->selection.is_active)
      {
         start_x = sd->pty->selection.start.x;
@@ -1786,38 +2012,18 @@ _take_selection(Evas_Object *obj, Elm_Sel_Type type)
         end_y = sd->pty->selection.end.y;
      }
 
-   if (sd->pty->selection.is_box)
+   box = sd->pty->selection.is_box;
+   if (box)
      {
-        int i;
-        Eina_Strbuf *sb;
-
         if (start_y > end_y)
           INT_SWAP(start_y, end_y);
         if (start_x > end_x)
           INT_SWAP(start_x, end_x);
-
-        sb = eina_strbuf_new();
-        for (i = start_y; i <= end_y; i++)
-          {
-             char *tmp = termio_selection_get(obj, start_x, i, end_x, i,
-                                              &len);
-
-             if (tmp)
-               {
-                  eina_strbuf_append_length(sb, tmp, len);
-                  if (len && tmp[len - 1] != '\n')
-                    eina_strbuf_append_char(sb, '\n');
-                  free(tmp);
-               }
-          }
-        len = eina_strbuf_length_get(sb);
-        s = eina_strbuf_string_steal(sb);
-        eina_strbuf_free(sb);
      }
    else if (!start_y && !end_y && !start_x && !end_x && sd->link.string)
      {
-        len = strlen(sd->link.string);
-        s = strndup(sd->link.string, len);
+        _take_selection_text(obj, type, sd->link.string);
+        return;
      }
    else if ((start_x != end_x) || (start_y != end_y))
      {
@@ -1826,13 +2032,32 @@ _take_selection(Evas_Object *obj, Elm_Sel_Type type)
              INT_SWAP(start_y, end_y);
              INT_SWAP(start_x, end_x);
           }
-        s = termio_selection_get(obj, start_x, start_y, end_x, end_y, &len);
      }
+   else return;
 
+   if ((end_y - start_y) >= SEL_COPY_ROWS)
+     {
+        // read it a bit at a time from an idler, and take it when done
+        sd->sel_copy.sr = termio_selection_read_new(obj, start_x, start_y,
+                                                    end_x, end_y, box);
+        sd->sel_copy.sb = eina_strbuf_new();
+        if ((!sd->sel_copy.sr) || (!sd->sel_copy.sb))
+          {
+             _sel_copy_stop(sd);
+             return;
+          }
+        sd->sel_copy.type = type;
+        sd->sel_copy.idler = ecore_idler_add(_smart_cb_sel_copy, obj);
+        return;
+     }
+   s = _selection_text_get(obj, start_x, start_y, end_x, end_y, box, &len);
    if (s)
      {
         if ((sd->win) && (len > 0))
-          _take_selection_text(obj, type, s);
+          {
+             _take_selection_own(obj, type, s, len);
+             return;
+          }
         free(s);
      }
 }
@@ -2161,6 +2386,24 @@ _smart_cb_key_down(void *data, Evas *e EINA_UNUSED,
              _paste_selection(data, ELM_SEL_TYPE_CLIPBOARD);
              goto end;
           }
+        else if (!strcasecmp(ev->key, "s"))
+          {
+             _compose_seq_reset(sd);
+             termio_export(data, NULL, EINA_FALSE);
+             goto end;
+          }
+        else if ((!strcmp(ev->key, "Up")) &&
+                 (termio_search_next(data, EINA_TRUE)))
+          {
+             _compose_seq_reset(sd);
+             goto end;
+          }
+        else if ((!strcmp(ev->key, "Down")) &&
+                 (termio_search_next(data, EINA_FALSE)))
+          {
+             _compose_seq_reset(sd);
+             goto end;
+          }
      }
    if ((evas_key_modifier_is_set(ev->modifiers, "Alt")) &&
        (!evas_key_modifier_is_set(ev->modifiers, "Shift")) &&
@@ -3045,6 +3288,8 @@ _smart_cb_mouse_down(void *data, Evas *e EINA_UNUSED, Evas_Object *obj EINA_UNUS
      if (_rep_mouse_down(sd, ev, cx, cy)) return;
    if (ev->button == 1)
      {
+        // whatever gets selected now is the user's
+        sd->search.sel = EINA_FALSE;
         if (ev->flags & EVAS_BUTTON_TRIPLE_CLICK)
           {
              _sel_line(data, cx, cy - sd->scroll);
@@ -3675,6 +3920,7 @@ _smart_add(Evas_Object *obj)
    evas_object_smart_member_add(o, obj);
    evas_object_show(o);
    sd->grid.obj = o;
+   sd->link.index = _termio_link_index_new();
 
    /* Setup cursor */
    o = edje_object_add(evas_object_evas_get(obj));
@@ -3815,12 +4061,18 @@ _smart_del(Evas_Object *obj)
    if (sd->sel.theme) evas_object_del(sd->sel.theme);
    if (sd->anim) ecore_animator_del(sd->anim);
    if (sd->delayed_size_timer) ecore_timer_del(sd->delayed_size_timer);
+   if (sd->resize_settle_timer) ecore_timer_del(sd->resize_settle_timer);
    if (sd->link_do_timer) ecore_timer_del(sd->link_do_timer);
    if (sd->mouse_move_job) ecore_job_del(sd->mouse_move_job);
    if (sd->mouseover_delay) ecore_timer_del(sd->mouseover_delay);
    if (sd->font.name) eina_stringshare_del(sd->font.name);
+   if (sd->search.idler) ecore_idler_del(sd->search.idler);
+   termpty_search_free(sd->search.se);
+   _termio_export_free(sd->export.ex);
    if (sd->pty) termpty_free(sd->pty);
    if (sd->link.string) free(sd->link.string);
+   if (sd->link.index_idler) ecore_idler_del(sd->link.index_idler);
+   _termio_link_index_free(sd->link.index);
    if (sd->glayer) evas_object_del(sd->glayer);
    if (sd->win)
      evas_object_event_callback_del_full(sd->win, EVAS_CALLBACK_DEL,
@@ -3832,12 +4084,18 @@ _smart_del(Evas_Object *obj)
      }
    if (sd->link.down.dndobj) evas_object_del(sd->link.down.dndobj);
    _compose_seq_reset(sd);
-   if (sd->sel_str) eina_stringshare_del(sd->sel_str);
+   _sel_copy_stop(sd);
+   free(sd->sel_str);
    if (sd->sel_reset_job) ecore_job_del(sd->sel_reset_job);
    EINA_LIST_FREE(sd->cur_chids, chid) eina_stringshare_del(chid);
    sd->sel_str = NULL;
    sd->sel_reset_job = NULL;
    sd->link.down.dndobj = NULL;
+   sd->link.index = NULL;
+   sd->link.index_idler = NULL;
+   sd->search.se = NULL;
+   sd->search.idler = NULL;
+   sd->export.ex = NULL;
    sd->cursor.obj = NULL;
    sd->event = NULL;
    sd->sel.top = NULL;
@@ -3845,6 +4103,7 @@ _smart_del(Evas_Object *obj)
    sd->sel.theme = NULL;
    sd->anim = NULL;
    sd->delayed_size_timer = NULL;
+   sd->resize_settle_timer = NULL;
    sd->font.name = NULL;
    sd->pty = NULL;
    sd->imf = NULL;
@@ -3936,6 +4195,18 @@ termio_scroll(Evas_Object *obj, int direction, int start_y, int end_y)
 
    EINA_SAFETY_ON_NULL_RETURN(sd);
 
+   if (sd->scrolled.n == 0)
+     {
+        sd->scrolled.start_y = start_y;
+        sd->scrolled.end_y = end_y;
+        sd->scrolled.n = direction;
+     }
+   else if ((sd->scrolled.start_y == start_y) &&
+            (sd->scrolled.end_y == end_y) &&
+            ((sd->scrolled.n < 0) == (direction < 0)))
+     sd->scrolled.n += direction;
+   else
+     sd->scrolled.mixed = EINA_TRUE;
    if ((!sd->jump_on_change) && // if NOT scroll to bottom on updates
        (sd->scroll > 0))
      {
@@ -4278,6 +4549,44 @@ _smart_pty_command(void *data)
              sd->pty->block.on = EINA_FALSE;
           }
      }
+   else if (sd->pty->cur_cmd[0] == 's')
+     {
+        if (sd->pty->cur_cmd[1] == 'f')
+          termio_search(obj, &(sd->pty->cur_cmd[2]), EINA_FALSE);
+        else if (sd->pty->cur_cmd[1] == 'r')
+          termio_search(obj, &(sd->pty->cur_cmd[2]), EINA_TRUE);
+        else if (sd->pty->cur_cmd[1] == 'p')
+          termio_search_next(obj, EINA_TRUE);
+        else if (sd->pty->cur_cmd[1] == 'n')
+          termio_search_next(obj, EINA_FALSE);
+        return;
+     }
+   else if (sd->pty->cur_cmd[0] == 'w')
+     {
+        // the file is always a new one termio names, and where it went is
+        // written back once it's all there. only if the config lets
+        // programs do that, and not over one still being written
+        if ((sd->pty->cur_cmd[1] == 't') || (sd->pty->cur_cmd[1] == 'e'))
+          {
+             Config *config = termio_config_get(obj);
+
+             if ((!config) || (!config->export_escapes))
+               {
+                  WRN("scrollback export escape ignored, not enabled");
+                  termpty_write(sd->pty, "\n", 1);
+               }
+             else if (sd->export.ex)
+               {
+                  WRN("scrollback export escape ignored, one is going on");
+                  termpty_write(sd->pty, "\n", 1);
+               }
+             else if (termio_export(obj, NULL, sd->pty->cur_cmd[1] == 'e'))
+               sd->export.reply = EINA_TRUE;
+             else
+               termpty_write(sd->pty, "\n", 1);
+          }
+        return;
+     }
    else if (sd->pty->cur_cmd[0] == 'q')
      {
         if (sd->pty->cur_cmd[1] == 's')
@@ -4450,6 +4759,8 @@ termio_add(Evas_Object *parent, Config *config, const char *cmd, Eina_Bool login
                        _smart_cb_drop, obj);
 #endif
    
+   termpty_save_budget_set((size_t)config->scrollback_mem * 1024 * 1024);
+   termpty_save_disk_set(config->scrollback_disk);
    sd->pty = termpty_new(cmd, login_shell, cd, w, h, config->scrollback,
                          config->xterm_256color, config->erase_is_del);
    if (!sd->pty)
@@ -4512,105 +4823,198 @@ termio_theme_get(Evas_Object *obj)
    return sd->theme;
 }
 
-char *
-termio_selection_get(Evas_Object *obj, int c1x, int c1y, int c2x, int c2y,
-                     size_t *len)
+//// selection text
+//
+// the text of a selection is worked out a row at a time into a row buffer,
+// so it's appended in one go per row, and handed out in pages of whatever
+// size the reader wants. rows are kept numbered like searches number them
+// (ty->search.lines + y) so a reader can go on across idlers while more
+// lines get saved. with sgr set the text keeps its colors and such as sgr
+// escapes. a reader can also take a snapshot of the rows it has left, after
+// which it never looks at the pty again and can be read from a thread
+
+struct _Termselread
 {
-   Termio *sd = evas_object_smart_data_get(obj);
-   Eina_Strbuf *sb;
-   char *s;
-   int x, y;
-   size_t len_backup;
+   Evas_Object *obj;
+   long long row, row2; // next row to do, and the last one
+   long long lines; // ty->search.lines when started
+   unsigned int gen;
+   int c1x, c1y, c2x, c2y; // as given, only the x's are used past the start
+   char *buf; // text of the row being handed out
+   int len, off, max;
+   Termatt att; // attributes the sgr escapes so far have set
+   Termsavesnap *snap; // if set, rows come from here and not the pty
+   long long snaprow, snaplines; // row snap starts at, and lines then
+   int snapw; // grid width then
+   Eina_Bool box : 1;
+   Eina_Bool sgr : 1;
+};
 
-   EINA_SAFETY_ON_NULL_RETURN_VAL(sd, NULL);
-   sb = eina_strbuf_new();
-   termpty_cellcomp_freeze(sd->pty);
-   for (y = c1y; y <= c2y; y++)
-     {
-        Termcell *cells;
-        int w, last0, v, start_x, end_x;
+static const Termatt _sgr_plain;
 
-        w = 0;
-        last0 = -1;
-        cells = termpty_cellrow_get(sd->pty, y, &w);
-        if (!cells) continue;
-        if (w > sd->grid.w) w = sd->grid.w;
-        if (y == c1y && c1x >= w)
+static Eina_Bool
+_sgr_same(const Termatt *a, const Termatt *b)
+{
+   return ((a->fg == b->fg) && (a->bg == b->bg) &&
+           (a->bold == b->bold) && (a->faint == b->faint) &&
+#if defined(SUPPORT_ITALIC)
+           (a->italic == b->italic) &&
+#endif
+           (a->underline == b->underline) && (a->blink == b->blink) &&
+           (a->blink2 == b->blink2) && (a->inverse == b->inverse) &&
+           (a->invisible == b->invisible) && (a->strike == b->strike) &&
+           (a->fg256 == b->fg256) && (a->bg256 == b->bg256) &&
+           (a->fgintense == b->fgintense) && (a->bgintense == b->bgintense));
+}
+
+// the escape that goes from whatever there was to att
+static char *
+_sgr_put(char *p, const Termatt *att)
+{
+   *p++ = 033;
+   *p++ = '[';
+   *p++ = '0';
+   if (att->bold) p += sprintf(p, ";1");
+   if (att->faint) p += sprintf(p, ";2");
+#if defined(SUPPORT_ITALIC)
+   if (att->italic) p += sprintf(p, ";3");
+#endif
+   if (att->underline) p += sprintf(p, ";4");
+   if (att->blink) p += sprintf(p, ";5");
+   if (att->blink2) p += sprintf(p, ";6");
+   if (att->inverse) p += sprintf(p, ";7");
+   if (att->invisible) p += sprintf(p, ";8");
+   if (att->strike) p += sprintf(p, ";9");
+   if (att->fg256) p += sprintf(p, ";38;5;%i", att->fg);
+   else if ((att->fg >= COL_BLACK) && (att->fg <= COL_WHITE))
+     p += sprintf(p, ";%i", (att->fgintense ? 90 : 30) + att->fg - COL_BLACK);
+   if (att->bg256) p += sprintf(p, ";48;5;%i", att->bg);
+   else if ((att->bg >= COL_BLACK) && (att->bg <= COL_WHITE))
+     p += sprintf(p, ";%i", (att->bgintense ? 100 : 40) + att->bg - COL_BLACK);
+   *p++ = 'm';
+   return p;
+}
+
+static inline char *
+_sgr_set(Termselread *sr, char *p, const Termatt *att)
+{
+   if ((!sr->sgr) || (_sgr_same(&(sr->att), att))) return p;
+   sr->att = *att;
+   return _sgr_put(p, att);
+}
+
+// a cell that doesn't show anything, unless escapes are kept and it has
+// a background
+static inline Eina_Bool
+_sel_cell_blank(const Termselread *sr, const Termcell *cell)
+{
+   if ((cell->codepoint != 0) && (cell->codepoint != ' ')) return EINA_FALSE;
+   if ((sr->sgr) && ((cell->att.bg != COL_DEF) || (cell->att.bg256) ||
+                     (cell->att.inverse)))
+     return EINA_FALSE;
+   return EINA_TRUE;
+}
+
+// appends row y of the selection from c1 to c2 to sr->buf, which has room
+static void
+_sel_row_text(Termselread *sr, Termcell *cells, int w, int y,
+              int c1x, int c1y, int c2x, int c2y)
+{
+   char *p = sr->buf + sr->len;
+   int x, last0 = -1, v, start_x, end_x;
+
+   if (y == c1y && c1x >= w)
+     {
+        *p++ = '\n';
+        sr->len = p - sr->buf;
+        return;
+     }
+   start_x = c1x;
+   end_x = (c2x >= w) ? w - 1 : c2x;
+   if (c1y != c2y)
+     {
+        if (y == c1y) end_x = w - 1;
+        else if (y == c2y) start_x = 0;
+        else
           {
-             eina_strbuf_append_char(sb, '\n');
-             continue;
+             start_x = 0;
+             end_x = w - 1;
           }
-        start_x = c1x;
-        end_x = (c2x >= w) ? w - 1 : c2x;
-        if (c1y != c2y)
+     }
+   for (x = start_x; x <= end_x; x++)
+     {
+#if defined(SUPPORT_DBLWIDTH)
+        if ((cells[x].codepoint == 0) && (cells[x].att.dblwidth))
           {
-             if (y == c1y) end_x = w - 1;
-             else if (y == c2y) start_x = 0;
-             else
-               {
-                  start_x = 0;
-                  end_x = w - 1;
-               }
+             if (x < end_x) x++;
+             else break;
           }
-        for (x = start_x; x <= end_x; x++)
-          {
-#if defined(SUPPORT_DBLWIDTH)
-             if ((cells[x].codepoint == 0) && (cells[x].att.dblwidth))
-               {
-                  if (x < end_x) x++;
-                  else break;
-               }
 #endif
-             if (x >= w) break;
-             if ((cells[x].codepoint == 0) || (cells[x].codepoint == ' '))
-               {
-                  if (last0 < 0) last0 = x;
-               }
-             else if (cells[x].att.newline)
+        if (x >= w) break;
+        if (_sel_cell_blank(sr, &(cells[x])))
+          {
+             if (last0 < 0) last0 = x;
+          }
+        else if (cells[x].att.newline)
+          {
+             last0 = -1;
+             if ((y != c2y) || (x != end_x)) *p++ = '\n';
+             break;
+          }
+        else if (cells[x].att.tab)
+          {
+             *p++ = '\t';
+             x = ((x + 8) / 8) * 8;
+             x--;
+          }
+        else
+          {
+             if (last0 >= 0)
                {
+                  v = x - last0 - 1;
                   last0 = -1;
-                  if ((y != c2y) || (x != end_x))
-                    eina_strbuf_append_char(sb, '\n');
-                  break;
+                  p = _sgr_set(sr, p, &_sgr_plain);
+                  for (; v >= 0; v--) *p++ = ' ';
                }
-             else if (cells[x].att.tab)
+             p = _sgr_set(sr, p, &(cells[x].att));
+             // only blanks with a background to keep get here as 0
+             p += codepoint_to_utf8(cells[x].codepoint ?
+                                    cells[x].codepoint : ' ', p);
+             if ((x == (w - 1)) && (x != c2x))
                {
-                  eina_strbuf_append_char(sb, '\t');
-                  x = ((x + 8) / 8) * 8;
-                  x--;
+                  if (!cells[x].att.autowrapped) *p++ = '\n';
                }
-             else
-               {
-                  char txt[8];
-                  int txtlen;
+          }
+     }
+   if (last0 >= 0)
+     {
+        if (y == c2y)
+          {
+             Eina_Bool have_more = EINA_FALSE;
 
-                  if (last0 >= 0)
+             for (x = end_x + 1; x < w; x++)
+               {
+#if defined(SUPPORT_DBLWIDTH)
+                  if ((cells[x].codepoint == 0) &&
+                      (cells[x].att.dblwidth))
                     {
-                       v = x - last0 - 1;
-                       last0 = -1;
-                       while (v >= 0)
-                         {
-                            eina_strbuf_append_char(sb, ' ');
-                            v--;
-                         }
+                       if (x < (w - 1)) x++;
+                       else break;
                     }
-                  txtlen = codepoint_to_utf8(cells[x].codepoint, txt);
-                  if (txtlen > 0)
-                    eina_strbuf_append_length(sb, txt, txtlen);
-                  if ((x == (w - 1)) && (x != c2x))
+#endif
+                  if ((!_sel_cell_blank(sr, &(cells[x]))) ||
+                      (cells[x].att.newline) ||
+                      (cells[x].att.tab))
                     {
-                       if (!cells[x].att.autowrapped)
-                         eina_strbuf_append_char(sb, '\n');
+                       have_more = EINA_TRUE;
+                       break;
                     }
                }
-          }
-        if (last0 >= 0)
-          {
-             if (y == c2y)
+             if (!have_more) *p++ = '\n';
+             else
                {
-                  Eina_Bool have_more = EINA_FALSE;
-
-                  for (x = end_x + 1; x < w; x++)
+                  p = _sgr_set(sr, p, &_sgr_plain);
+                  for (x = last0; x <= end_x; x++)
                     {
 #if defined(SUPPORT_DBLWIDTH)
                        if ((cells[x].codepoint == 0) &&
@@ -4620,37 +5024,203 @@ termio_selection_get(Evas_Object *obj, int c1x, int c1y, int c2x, int c2y,
                             else break;
                          }
 #endif
-                       if (((cells[x].codepoint != 0) &&
-                            (cells[x].codepoint != ' ')) ||
-                           (cells[x].att.newline) ||
-                           (cells[x].att.tab))
-                         {
-                            have_more = EINA_TRUE;
-                            break;
-                         }
-                    }
-                  if (!have_more) eina_strbuf_append_char(sb, '\n');
-                  else
-                    {
-                       for (x = last0; x <= end_x; x++)
-                         {
-#if defined(SUPPORT_DBLWIDTH)
-                            if ((cells[x].codepoint == 0) &&
-                                (cells[x].att.dblwidth))
-                              {
-                                 if (x < (w - 1)) x++;
-                                 else break;
-                              }
-#endif
-                            if (x >= w) break;
-                            eina_strbuf_append_char(sb, ' ');
-                         }
+                       if (x >= w) break;
+                       *p++ = ' ';
                     }
                }
-             else eina_strbuf_append_char(sb, '\n');
           }
+        else *p++ = '\n';
      }
-   termpty_cellcomp_thaw(sd->pty);
+   sr->len = p - sr->buf;
+}
+
+// works out the text of the next row into sr->buf. returns EINA_FALSE if
+// the lines it's in are gone
+static Eina_Bool
+_sel_row_next(Termselread *sr, Termio *sd)
+{
+   Termcell *cells;
+   long long lines;
+   int y, w = 0, gridw, per = sr->sgr ? 7 + SGR_MAX : 7;
+
+   sr->len = sr->off = 0;
+   if (sr->snap)
+     {
+        lines = sr->snaplines;
+        gridw = sr->snapw;
+        y = sr->row - lines;
+        cells = termpty_save_snap_row_get(sr->snap, sr->row - sr->snaprow,
+                                          &w);
+        sr->row++;
+     }
+   else
+     {
+        Termpty *ty = sd->pty;
+
+        if (ty->search.gen != sr->gen) return EINA_FALSE;
+        lines = ty->search.lines;
+        gridw = sd->grid.w;
+        y = sr->row - lines;
+        sr->row++;
+        // it scrolled off the top of the scrollback while being read
+        if ((lines != sr->lines) && (y < -ty->backscroll_num))
+          return EINA_FALSE;
+        cells = termpty_cellrow_get(ty, y, &w);
+     }
+   if (!cells) w = 0;
+   if (w > gridw) w = gridw;
+   // every cell is at most a utf8 sequence (and its nul) and an escape
+   // before it, then newlines and the escape ending it all at the end
+   if (sr->max < ((w * per) + 8 + SGR_MAX))
+     {
+        char *tmp = realloc(sr->buf, (w * per) + 8 + SGR_MAX);
+
+        if (!tmp) return EINA_FALSE;
+        sr->buf = tmp;
+        sr->max = (w * per) + 8 + SGR_MAX;
+     }
+   if (!cells) goto done;
+   if (sr->box)
+     {
+        _sel_row_text(sr, cells, w, y, sr->c1x, y, sr->c2x, y);
+        if ((sr->len > 0) && (sr->buf[sr->len - 1] != '\n'))
+          sr->buf[sr->len++] = '\n';
+     }
+   else
+     _sel_row_text(sr, cells, w, y, sr->c1x,
+                   sr->c1y - (lines - sr->lines),
+                   sr->c2x, sr->c2y - (lines - sr->lines));
+done:
+   if (sr->row > sr->row2)
+     sr->len = _sgr_set(sr, sr->buf + sr->len, &_sgr_plain) - sr->buf;
+   return EINA_TRUE;
+}
+
+// a reader of the text from c1 to c2 (both in pty rows), or of the box
+// they are the corners of. it goes on even as the pty scrolls
+Termselread *
+termio_selection_read_new(Evas_Object *obj, int c1x, int c1y, int c2x, int c2y,
+                          Eina_Bool box)
+{
+   Termio *sd = evas_object_smart_data_get(obj);
+   Termselread *sr;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(sd, NULL);
+   sr = calloc(1, sizeof(Termselread));
+   if (!sr) return NULL;
+   sr->obj = obj;
+   sr->lines = sd->pty->search.lines;
+   sr->gen = sd->pty->search.gen;
+   sr->row = sr->lines + c1y;
+   sr->row2 = sr->lines + c2y;
+   sr->c1x = c1x;
+   sr->c1y = c1y;
+   sr->c2x = c2x;
+   sr->c2y = c2y;
+   sr->box = box;
+   return sr;
+}
+
+// keep colors and such as sgr escapes in the text
+void
+termio_selection_read_sgr_set(Termselread *sr, Eina_Bool sgr)
+{
+   sr->sgr = sgr;
+}
+
+// copies the rows sr has left to read, after this it reads the copy. only
+// the reading then may happen in another thread, freeing it may not. fails
+// if the rows already went away
+Eina_Bool
+termio_selection_read_snapshot(Termselread *sr)
+{
+   Termio *sd = evas_object_smart_data_get(sr->obj);
+   Termpty *ty;
+   long long y1, y2;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(sd, EINA_FALSE);
+   ty = sd->pty;
+   if ((sr->snap) || (sr->row > sr->row2)) return EINA_TRUE;
+   if (ty->search.gen != sr->gen) return EINA_FALSE;
+   y1 = sr->row - ty->search.lines;
+   y2 = MIN(sr->row2 - ty->search.lines, ty->h - 1);
+   if ((ty->search.lines != sr->lines) && (y1 < -ty->backscroll_num))
+     return EINA_FALSE;
+   termpty_cellcomp_freeze(ty);
+   sr->snap = termpty_save_snap_new(ty, y1, y2);
+   termpty_cellcomp_thaw(ty);
+   if (!sr->snap) return EINA_FALSE;
+   sr->snaprow = sr->row;
+   sr->snaplines = ty->search.lines;
+   sr->snapw = sd->grid.w;
+   return EINA_TRUE;
+}
+
+void
+termio_selection_read_free(Termselread *sr)
+{
+   if (!sr) return;
+   termpty_save_snap_free(sr->snap);
+   free(sr->buf);
+   free(sr);
+}
+
+// fills buf with up to size bytes more of the text. returns how many, 0 at
+// the end, or -1 if the lines it was reading went away (were cleared,
+// rewrapped or scrolled off the top)
+ssize_t
+termio_selection_read(Termselread *sr, char *buf, size_t size)
+{
+   Termio *sd = NULL;
+   size_t n = 0, todo;
+   Eina_Bool ok = EINA_TRUE;
+
+   // a snapshot may be read from another thread, which mustn't touch obj
+   if (!sr->snap)
+     {
+        sd = evas_object_smart_data_get(sr->obj);
+        EINA_SAFETY_ON_NULL_RETURN_VAL(sd, -1);
+        termpty_cellcomp_freeze(sd->pty);
+     }
+   while (n < size)
+     {
+        if (sr->off < sr->len)
+          {
+             todo = sr->len - sr->off;
+             if (todo > (size - n)) todo = size - n;
+             memcpy(buf + n, sr->buf + sr->off, todo);
+             sr->off += todo;
+             n += todo;
+             continue;
+          }
+        if (sr->row > sr->row2) break;
+        if (!_sel_row_next(sr, sd))
+          {
+             ok = EINA_FALSE;
+             break;
+          }
+     }
+   if (sd) termpty_cellcomp_thaw(sd->pty);
+   if (!ok) return -1;
+   return n;
+}
+
+static char *
+_selection_text_get(Evas_Object *obj, int c1x, int c1y, int c2x, int c2y,
+                    Eina_Bool box, size_t *len)
+{
+   Termselread *sr;
+   Eina_Strbuf *sb;
+   char *s, page[4096];
+   ssize_t n;
+   size_t len_backup;
+
+   sr = termio_selection_read_new(obj, c1x, c1y, c2x, c2y, box);
+   if (!sr) return NULL;
+   sb = eina_strbuf_new();
+   while ((n = termio_selection_read(sr, page, sizeof(page))) > 0)
+     eina_strbuf_append_length(sb, page, n);
+   termio_selection_read_free(sr);
 
    if (!len) len = &len_backup;
    *len = eina_strbuf_length_get(sb);
@@ -4664,6 +5234,13 @@ termio_selection_get(Evas_Object *obj, int c1x, int c1y, int c2x, int c2y,
    return s;
 }
 
+char *
+termio_selection_get(Evas_Object *obj, int c1x, int c1y, int c2x, int c2y,
+                     size_t *len)
+{
+   return _selection_text_get(obj, c1x, c1y, c2x, c2y, EINA_FALSE, len);
+}
+
 void
 termio_config_update(Evas_Object *obj)
 {
@@ -4690,6 +5267,8 @@ termio_config_update(Evas_Object *obj)
    sd->jump_on_keypress = sd->config->jump_on_keypress;
 
    termpty_backscroll_set(sd->pty, sd->config->scrollback);
+   termpty_save_budget_set((size_t)sd->config->scrollback_mem * 1024 * 1024);
+   termpty_save_disk_set(sd->config->scrollback_disk);
    sd->scroll = 0;
 
    if (evas_object_focus_get(obj))
@@ -4794,6 +5373,14 @@ termio_pid_get(const Evas_Object *obj)
    return termpty_pid_get(sd->pty);
 }
 
+Termpty *
+termio_pty_get(const Evas_Object *obj)
+{
+   Termio *sd = evas_object_smart_data_get(obj);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(sd, NULL);
+   return sd->pty;
+}
+
 Eina_Bool
 termio_cwd_get(const Evas_Object *obj, char *buf, size_t size)
 {
@@ -4886,6 +5473,7 @@ termio_debugwhite_set(Evas_Object *obj, Eina_Bool dbg)
    Termio *sd = evas_object_smart_data_get(obj);
    EINA_SAFETY_ON_NULL_RETURN(sd);
    sd->debugwhite = dbg;
+   termpty_dirty_all(sd->pty);
    _smart_apply(obj);
 }
 
@@ -4896,3 +5484,191 @@ termio_selection_exists(const Evas_Object *obj)
    EINA_SAFETY_ON_NULL_RETURN_VAL(sd, EINA_FALSE);
    return sd->pty->selection.is_active;
 }
+
+//// scrollback search
+
+static void
+_search_found(Evas_Object *obj, Termio *sd, int x1, int y1, int x2, int y2)
+{
+   _sel_set(obj, EINA_TRUE);
+   sd->pty->selection.is_box = EINA_FALSE;
+   sd->pty->selection.makesel = EINA_FALSE;
+   sd->pty->selection.start.x = x1;
+   sd->pty->selection.start.y = y1;
+   sd->pty->selection.end.x = x2;
+   sd->pty->selection.end.y = y2;
+   sd->search.sel = EINA_TRUE;
+   // bring it to the middle of the view if it's not in it
+   if ((y1 < -sd->scroll) || (y2 > (sd->grid.h - 1 - sd->scroll)))
+     {
+        sd->scroll = (sd->grid.h / 2) - y1;
+        if (sd->scroll > sd->pty->backscroll_num)
+          sd->scroll = sd->pty->backscroll_num;
+        if (sd->scroll < 0) sd->scroll = 0;
+     }
+   _smart_update_queue(obj, sd);
+}
+
+static Eina_Bool
+_search_run(Evas_Object *obj, Termio *sd)
+{
+   int x1 = 0, y1 = 0, x2 = 0, y2 = 0, r;
+
+   r = termpty_search_step(sd->search.se, sd->search.up, SEARCH_ROWS,
+                           &x1, &y1, &x2, &y2);
+   if (r < 0) return EINA_TRUE;
+   if (r > 0) _search_found(obj, sd, x1, y1, x2, y2);
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_smart_cb_search(void *data)
+{
+   Evas_Object *obj = data;
+   Termio *sd = evas_object_smart_data_get(obj);
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(sd, EINA_FALSE);
+   if (_search_run(obj, sd)) return EINA_TRUE;
+   sd->search.idler = NULL;
+   return EINA_FALSE;
+}
+
+static void
+_search_go(Evas_Object *obj, Termio *sd, Eina_Bool up)
+{
+   sd->search.up = up;
+   if (_search_run(obj, sd))
+     {
+        if (!sd->search.idler)
+          sd->search.idler = ecore_idler_add(_smart_cb_search, obj);
+     }
+   else if (sd->search.idler)
+     {
+        ecore_idler_del(sd->search.idler);
+        sd->search.idler = NULL;
+     }
+}
+
+static void
+_search_unsel(Evas_Object *obj, Termio *sd)
+{
+   if (sd->search.idler)
+     {
+        ecore_idler_del(sd->search.idler);
+        sd->search.idler = NULL;
+     }
+   if (!sd->search.sel) return;
+   sd->search.sel = EINA_FALSE;
+   _sel_set(obj, EINA_FALSE);
+   _smart_update_queue(obj, sd);
+}
+
+// looks for str (a regex if regex is set) from the bottom of the view up,
+// or from where the last one started from if it's a search being typed in.
+// an empty or NULL str ends the search
+void
+termio_search(Evas_Object *obj, const char *str, Eina_Bool regex)
+{
+   Termio *sd = evas_object_smart_data_get(obj);
+
+   EINA_SAFETY_ON_NULL_RETURN(sd);
+   _search_unsel(obj, sd);
+   if ((!str) || (!str[0]))
+     {
+        termpty_search_free(sd->search.se);
+        sd->search.se = NULL;
+        return;
+     }
+   if (!sd->search.se)
+     {
+        sd->search.se = termpty_search_new(sd->pty,
+                                           sd->grid.h - 1 - sd->scroll,
+                                           sd->grid.w);
+        if (!sd->search.se) return;
+     }
+   // a regex that doesn't compile (yet) finds nothing
+   if (!termpty_search_query_set(sd->search.se, str, regex)) return;
+   _search_go(obj, sd, EINA_TRUE);
+}
+
+// the match above (older) or below the last one, if searching
+Eina_Bool
+termio_search_next(Evas_Object *obj, Eina_Bool up)
+{
+   Termio *sd = evas_object_smart_data_get(obj);
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(sd, EINA_FALSE);
+   if (!sd->search.se) return EINA_FALSE;
+   _search_go(obj, sd, up);
+   return EINA_TRUE;
+}
+
+//// scrollback export
+
+static void
+_smart_cb_export_done(void *data, const char *path, Eina_Bool ok,
+                      Eina_Bool truncated)
+{
+   Evas_Object *obj = data;
+   Termio *sd = evas_object_smart_data_get(obj);
+
+   EINA_SAFETY_ON_NULL_RETURN(sd);
+   // it frees itself after this
+   sd->export.ex = NULL;
+   // the lines went while it was read, the file has what came before
+   if ((ok) && (truncated))
+     WRN("exported scrollback to %s, cut short", path);
+   else if (ok) INF("exported scrollback to %s", path);
+   if (sd->export.reply)
+     {
+        if (ok) termpty_write(sd->pty, path, strlen(path));
+        termpty_write(sd->pty, "\n", 1);
+     }
+   sd->export.reply = EINA_FALSE;
+}
+
+// writes the scrollback and screen to path as text, with sgr escapes for
+// colors and such if sgr is set. with no path it goes to a new file in
+// the home directory. one still being written is stopped
+Eina_Bool
+termio_export(Evas_Object *obj, const char *path, Eina_Bool sgr)
+{
+   Termio *sd = evas_object_smart_data_get(obj);
+   char buf[PATH_MAX], home[PATH_MAX], date[64];
+   time_t t;
+   int i;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(sd, EINA_FALSE);
+   if (sd->export.ex)
+     {
+        WRN("stopping scrollback export, another one was asked for");
+        // whoever asked for it with an escape is still waiting to hear
+        if (sd->export.reply) termpty_write(sd->pty, "\n", 1);
+        _termio_export_free(sd->export.ex);
+        sd->export.ex = NULL;
+     }
+   sd->export.reply = EINA_FALSE;
+   if ((path) && (path[0]))
+     {
+        sd->export.ex = _termio_export_new(obj, path, sgr, EINA_TRUE,
+                                           _smart_cb_export_done, obj);
+        return !!sd->export.ex;
+     }
+   if (!homedir_get(home, sizeof(home))) return EINA_FALSE;
+   t = time(NULL);
+   strftime(date, sizeof(date), "%Y%m%d-%H%M%S", localtime(&t));
+   for (i = 0; i < 100; i++)
+     {
+        if (i == 0)
+          snprintf(buf, sizeof(buf), "%s/terminology-%s.txt", home, date);
+        else
+          snprintf(buf, sizeof(buf), "%s/terminology-%s-%i.txt",
+                   home, date, i);
+        if (access(buf, F_OK) == 0) continue;
+        sd->export.ex = _termio_export_new(obj, buf, sgr, EINA_FALSE,
+                                           _smart_cb_export_done, obj);
+        return !!sd->export.ex;
+     }
+   ERR("could not find a name to export scrollback to in %s", home);
+   return EINA_FALSE;
+}
@@ -3,6 +3,9 @@
 
 #include "config.h"
 #include "col.h"
+#include "termpty.h"
+
+typedef struct _Termselread Termselread;
 
 Evas_Object *termio_add(Evas_Object *parent, Config *config, const char *cmd, Eina_Bool login_shell, const char *cd, int w, int h);
 void         termio_win_set(Evas_Object *obj, Evas_Object *win);
@@ -11,6 +14,13 @@ Evas_Object *termio_theme_get(Evas_Object *obj);
 char        *termio_selection_get(Evas_Object *obj,
                                   int c1x, int c1y, int c2x, int c2y,
                                   size_t *len);
+Termselread *termio_selection_read_new(Evas_Object *obj,
+                                       int c1x, int c1y, int c2x, int c2y,
+                                       Eina_Bool box);
+void         termio_selection_read_sgr_set(Termselread *sr, Eina_Bool sgr);
+Eina_Bool    termio_selection_read_snapshot(Termselread *sr);
+ssize_t      termio_selection_read(Termselread *sr, char *buf, size_t size);
+void         termio_selection_read_free(Termselread *sr);
 Eina_Bool    termio_selection_exists(const Evas_Object *obj);
 void termio_scroll(Evas_Object *obj, int direction, int start_y, int end_y);
 void termio_content_change(Evas_Object *obj, Evas_Coord x, Evas_Coord y, int n);
@@ -27,6 +37,7 @@ int          termio_scroll_get(Evas_Object *obj);
 void         termio_font_size_set(Evas_Object *obj, int size);
 void         termio_grid_size_set(Evas_Object *obj, int w, int h);
 pid_t        termio_pid_get(const Evas_Object *obj);
+Termpty     *termio_pty_get(const Evas_Object *obj);
 Eina_Bool    termio_cwd_get(const Evas_Object *obj, char *buf, size_t size);
 Evas_Object *termio_textgrid_get(Evas_Object *obj);
 Evas_Object *termio_win_get(Evas_Object *obj);
@@ -35,6 +46,9 @@ const char  *termio_title_get(Evas_Object *obj);
 const char  *termio_icon_name_get(Evas_Object *obj);
 void         termio_debugwhite_set(Evas_Object *obj, Eina_Bool dbg);
 void         termio_config_set(Evas_Object *obj, Config *config);
+void         termio_search(Evas_Object *obj, const char *str, Eina_Bool regex);
+Eina_Bool    termio_search_next(Evas_Object *obj, Eina_Bool up);
+Eina_Bool    termio_export(Evas_Object *obj, const char *path, Eina_Bool sgr);
 Config      *termio_config_get(const Evas_Object *obj);
 
 #endif
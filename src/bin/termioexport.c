@@ -0,0 +1,284 @@
+#include "private.h"
+#include <Elementary.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "termio.h"
+#include "termioexport.h"
+
+//// scrollback export
+//
+// the rows to export are snapshotted in the mainloop when it starts, frames
+// still compressed (see termpty_save_snap_new()), so a resize, a clear or
+// the scrollback moving on doesn't change what gets written. a thread then
+// decompresses the frames one at a time, works out their text and writes
+// it out, and pokes the mainloop through a pipe once it's done. without
+// Eina_Thread an idler does the same a few pages at a time
+
+#define EXPORT_PAGE      (64 * 1024)
+#define EXPORT_PAGES     4 // read and written per idler call, no threads
+
+struct _Termexport
+{
+   Evas_Object *obj;
+   Termselread *sr;
+   char *path;
+   void (*done) (void *data, const char *path, Eina_Bool ok,
+                 Eina_Bool truncated);
+   void *data;
+   Ecore_Idler *idler;
+   int fd;
+   char *page;
+#if (EINA_VERSION_MAJOR > 1) || (EINA_VERSION_MINOR >= 8)
+   Ecore_Fd_Handler *hand_wake;
+   Eina_Thread thread;
+   Eina_Lock lock;
+   int wake[2];
+   Eina_Bool quit; // only touched with the lock held
+#endif
+   // these belong to the thread while there is one
+   Eina_Bool failed; // writing didn't work
+   Eina_Bool broken; // reading didn't
+   Eina_Bool created; // path is a new file we made
+};
+
+static Eina_Bool
+_fd_write(int fd, const char *buf, size_t len)
+{
+   ssize_t n;
+
+   while (len > 0)
+     {
+        n = write(fd, buf, len);
+        if (n < 0)
+          {
+             if (errno == EINTR) continue;
+             return EINA_FALSE;
+          }
+        buf += n;
+        len -= n;
+     }
+   return EINA_TRUE;
+}
+
+// reads the next page and writes it, returns if there's more to do
+static Eina_Bool
+_export_page(Termexport *ex)
+{
+   ssize_t n;
+
+   n = termio_selection_read(ex->sr, ex->page, EXPORT_PAGE);
+   if (n <= 0)
+     {
+        // only running out of memory gets a snapshot to fail
+        if (n < 0) ex->broken = EINA_TRUE;
+        return EINA_FALSE;
+     }
+   if (_fd_write(ex->fd, ex->page, n)) return EINA_TRUE;
+   ex->failed = EINA_TRUE;
+   return EINA_FALSE;
+}
+
+static void
+_export_end(Termexport *ex)
+{
+   Eina_Bool ok = !ex->failed;
+
+   if (ex->idler) ecore_idler_del(ex->idler);
+   ex->idler = NULL;
+   if ((ex->fd >= 0) && (close(ex->fd) < 0)) ok = EINA_FALSE;
+   ex->fd = -1;
+   // if only reading broke off, what got written is still worth keeping
+   if (!ok)
+     {
+        ERR("could not export scrollback to %s", ex->path);
+        if (ex->created) unlink(ex->path);
+     }
+   if (ex->done) ex->done(ex->data, ex->path, ok, ex->broken);
+   _termio_export_free(ex);
+}
+
+#if (EINA_VERSION_MAJOR > 1) || (EINA_VERSION_MINOR >= 8)
+
+static void *
+_export_thread(void *data, Eina_Thread t EINA_UNUSED)
+{
+   Termexport *ex = data;
+   Eina_Bool quit = EINA_FALSE;
+   char c = 0;
+
+   while (!quit)
+     {
+        if (!_export_page(ex)) break;
+        eina_lock_take(&ex->lock);
+        quit = ex->quit;
+        eina_lock_release(&ex->lock);
+     }
+   if ((!quit) && (write(ex->wake[1], &c, 1) < 0))
+     ERR("export wake write failed: %s", strerror(errno));
+   return NULL;
+}
+
+static Eina_Bool
+_cb_export_wake(void *data, Ecore_Fd_Handler *fd_handler EINA_UNUSED)
+{
+   Termexport *ex = data;
+   char buf[64];
+
+   // the thread only wakes us once it's done
+   while (read(ex->wake[0], buf, sizeof(buf)) > 0);
+   eina_thread_join(ex->thread);
+   ex->hand_wake = NULL;
+   _export_end(ex);
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_export_start(Termexport *ex)
+{
+   int i;
+
+   if (pipe(ex->wake) < 0)
+     {
+        ex->wake[0] = ex->wake[1] = -1;
+        return EINA_FALSE;
+     }
+   for (i = 0; i < 2; i++)
+     {
+        fcntl(ex->wake[i], F_SETFL, O_NONBLOCK);
+        fcntl(ex->wake[i], F_SETFD, FD_CLOEXEC);
+     }
+   eina_lock_new(&ex->lock);
+   ex->hand_wake = ecore_main_fd_handler_add(ex->wake[0], ECORE_FD_READ,
+                                             _cb_export_wake, ex,
+                                             NULL, NULL);
+   if (!ex->hand_wake) return EINA_FALSE;
+   if (!eina_thread_create(&ex->thread, EINA_THREAD_BACKGROUND, -1,
+                           _export_thread, ex))
+     {
+        ecore_main_fd_handler_del(ex->hand_wake);
+        ex->hand_wake = NULL;
+        return EINA_FALSE;
+     }
+   return EINA_TRUE;
+}
+
+static void
+_export_stop(Termexport *ex)
+{
+   if (ex->hand_wake)
+     {
+        eina_lock_take(&ex->lock);
+        ex->quit = EINA_TRUE;
+        eina_lock_release(&ex->lock);
+        eina_thread_join(ex->thread);
+        ecore_main_fd_handler_del(ex->hand_wake);
+        ex->hand_wake = NULL;
+     }
+   if (ex->wake[0] >= 0)
+     {
+        close(ex->wake[0]);
+        close(ex->wake[1]);
+        eina_lock_free(&ex->lock);
+     }
+   ex->wake[0] = ex->wake[1] = -1;
+}
+
+#else
+
+static Eina_Bool
+_cb_export_idler(void *data)
+{
+   Termexport *ex = data;
+   int i;
+
+   for (i = 0; i < EXPORT_PAGES; i++)
+     {
+        if (!_export_page(ex))
+          {
+             ex->idler = NULL;
+             _export_end(ex);
+             return EINA_FALSE;
+          }
+     }
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_export_start(Termexport *ex)
+{
+   ex->idler = ecore_idler_add(_cb_export_idler, ex);
+   return !!ex->idler;
+}
+
+static void
+_export_stop(Termexport *ex EINA_UNUSED)
+{
+}
+
+#endif
+
+// writes all of the scrollback and screen of obj's pty as they are now to
+// path, escapes and all if sgr is set. done is called with how it went once
+// it's all written, unless it's freed before. truncated is set if reading
+// them failed part way, the file then stops there
+Termexport *
+_termio_export_new(Evas_Object *obj, const char *path, Eina_Bool sgr,
+                   Eina_Bool overwrite,
+                   void (*done) (void *data, const char *path,
+                                 Eina_Bool ok, Eina_Bool truncated),
+                   void *data)
+{
+   Termpty *ty = termio_pty_get(obj);
+   Termexport *ex;
+   int flags = O_WRONLY | O_CREAT;
+
+   if (!ty) return NULL;
+   ex = calloc(1, sizeof(Termexport));
+   if (!ex) return NULL;
+   ex->obj = obj;
+   ex->done = done;
+   ex->data = data;
+#if (EINA_VERSION_MAJOR > 1) || (EINA_VERSION_MINOR >= 8)
+   ex->wake[0] = ex->wake[1] = -1;
+#endif
+   ex->path = strdup(path);
+   if (overwrite) flags |= O_TRUNC;
+   else flags |= O_EXCL;
+   ex->fd = open(path, flags, 0600);
+   if (ex->fd < 0)
+     {
+        ERR("could not open %s: %s", path, strerror(errno));
+        _termio_export_free(ex);
+        return NULL;
+     }
+   fcntl(ex->fd, F_SETFD, FD_CLOEXEC);
+   ex->created = !overwrite;
+   ex->page = malloc(EXPORT_PAGE);
+   ex->sr = termio_selection_read_new(obj, 0, -ty->backscroll_num,
+                                      ty->w - 1, ty->h - 1, EINA_FALSE);
+   if (ex->sr) termio_selection_read_sgr_set(ex->sr, sgr);
+   if ((!ex->path) || (!ex->page) || (!ex->sr) ||
+       (!termio_selection_read_snapshot(ex->sr)) || (!_export_start(ex)))
+     {
+        ERR("could not start exporting scrollback to %s", path);
+        if (ex->created) unlink(path);
+        _termio_export_free(ex);
+        return NULL;
+     }
+   return ex;
+}
+
+// stops an export still going on, what it wrote so far stays
+void
+_termio_export_free(Termexport *ex)
+{
+   if (!ex) return;
+   if (ex->idler) ecore_idler_del(ex->idler);
+   _export_stop(ex);
+   if (ex->fd >= 0) close(ex->fd);
+   termio_selection_read_free(ex->sr);
+   free(ex->page);
+   free(ex->path);
+   free(ex);
+}
@@ -0,0 +1,4 @@
+typedef struct _Termexport Termexport;
+
+Termexport *_termio_export_new(Evas_Object *obj, const char *path, Eina_Bool sgr, Eina_Bool overwrite, void (*done) (void *data, const char *path, Eina_Bool ok, Eina_Bool truncated), void *data);
+void        _termio_export_free(Termexport *ex);
@@ -1,42 +1,120 @@
 #include "private.h"
 #include <Elementary.h>
 #include "termio.h"
+#include "termiolink.h"
+#include "termpty.h"
 #include "utils.h"
 
+// the link finder walks the visible cells one at a time, moving on to the
+// next or previous row only where the text wrapped there. row ends that
+// weren't wrapped and the edges of the screen count as whitespace
+typedef struct _Linkpos Linkpos;
+
+struct _Linkpos
+{
+   Termpty *ty;
+   Termcell *cells;
+   int x, y; // in screen coordinates, like the mouse
+   int w, h, sc;
+   int row, cw; // screen row cells is for and its width
+};
+
+static void
+_linkpos_row(Linkpos *p, int y)
+{
+   if ((p->cells) && (p->row == y)) return;
+   p->cw = 0;
+   p->row = y;
+   p->cells = termpty_cellrow_get(p->ty, y - p->sc, &(p->cw));
+   if (!p->cells) p->cw = 0;
+   if (p->cw > p->w) p->cw = p->w;
+}
+
+// the row ran on into the next one
+static Eina_Bool
+_linkpos_wrapped(Linkpos *p, int y)
+{
+   _linkpos_row(p, y);
+   if (p->cw <= 0) return EINA_FALSE;
+   return p->cells[p->cw - 1].att.autowrapped;
+}
+
+// codepoint at the position, ' ' for blanks and tabs
+static int
+_linkpos_char(Linkpos *p)
+{
+   int g;
+
+   _linkpos_row(p, p->y);
+   if (p->x >= p->cw) return ' ';
+   g = p->cells[p->x].codepoint;
+   if ((g == 0) || (p->cells[p->x].att.tab)) return ' ';
+   return g;
+}
+
+// right half of a double width character
+static Eina_Bool
+_linkpos_dblwidth_cont(Linkpos *p)
+{
+   _linkpos_row(p, p->y);
+#if defined(SUPPORT_DBLWIDTH)
+   return ((p->x < p->cw) && (p->cells[p->x].codepoint == 0) &&
+           (p->cells[p->x].att.dblwidth));
+#else
+   return EINA_FALSE;
+#endif
+}
+
 static Eina_Bool
-coord_back(int *x, int *y, int w, int h EINA_UNUSED)
+_linkpos_back(Linkpos *p)
 {
-   (*x)--;
-   if ((*x) < 0)
+   if (p->x > 0) p->x--;
+   else
      {
-        if ((*y) <= 0)
-          {
-             (*x)++;
-             return EINA_FALSE;
-          }
-        (*x) = w - 1;
-        (*y)--;
+        if ((p->y <= 0) || (!_linkpos_wrapped(p, p->y - 1)))
+          return EINA_FALSE;
+        p->y--;
+        p->x = p->cw - 1;
      }
+   if ((p->x > 0) && (_linkpos_dblwidth_cont(p))) p->x--;
    return EINA_TRUE;
 }
 
 static Eina_Bool
-coord_forward(int *x, int *y, int w, int h)
+_linkpos_forward(Linkpos *p)
 {
-   (*x)++;
-   if ((*x) >= w)
+   do
      {
-        if ((*y) >= (h - 1))
+        _linkpos_row(p, p->y);
+        if (p->x < (p->cw - 1)) p->x++;
+        else
           {
-             (*x)--;
-             return EINA_FALSE;
+             if ((p->y >= (p->h - 1)) || (!_linkpos_wrapped(p, p->y)))
+               return EINA_FALSE;
+             p->y++;
+             p->x = 0;
           }
-        (*x) = 0;
-        (*y)++;
      }
+   while (_linkpos_dblwidth_cont(p));
    return EINA_TRUE;
 }
 
+static char
+_link_endmatch_get(int g)
+{
+   switch (g)
+     {
+      case '"': return '"';
+      case '\'': return '\'';
+      case '`': return '\'';
+      case '<': return '>';
+      case '[': return ']';
+      case '{': return '}';
+      case '(': return ')';
+     }
+   return 0;
+}
+
 static char *
 _cwd_path_get(const Evas_Object *obj, const char *relpath)
 {
@@ -94,133 +172,166 @@ _is_file(const char *str)
      }
 }
 
-char *
-_termio_link_find(Evas_Object *obj, int cx, int cy,
-                  int *x1r, int *y1r, int *x2r, int *y2r)
+// a protocol ends with the last of the n characters in str, so wasn't
+// there one character earlier
+static Eina_Bool
+_link_protocol_ends(char *str, int n)
+{
+   Eina_Bool ends = EINA_FALSE;
+   int k;
+   char c;
+
+   for (k = n - 1; (k >= 0) && (!ends); k--)
+     {
+        if (!link_is_protocol(str + k)) continue;
+        c = str[n - 1];
+        str[n - 1] = 0;
+        ends = !link_is_protocol(str + k);
+        str[n - 1] = c;
+     }
+   return ends;
+}
+
+static void
+_link_tail_add(char *tail, int *n, int max, int g)
+{
+   if (*n == max)
+     {
+        memmove(tail, tail + 1, max - 1);
+        (*n)--;
+     }
+   tail[(*n)++] = ((g > 0) && (g < 0x80)) ? g : 0x7f;
+   tail[*n] = 0;
+}
+
+// the link at cx, cy if there is one, as it is on screen. nextr gets the
+// first column on row cy past cx where the answer may be different: the end
+// of the word, or a space, bracket or protocol in it a hover there would
+// stop at
+static char *
+_link_find(Evas_Object *obj, int cx, int cy,
+           int *x1r, int *y1r, int *x2r, int *y2r, int *nextr)
 {
-   char *s;
-   char endmatch = 0;
-   int x1, x2, y1, y2, w = 0, h = 0, sc;
-   size_t len;
-   Eina_Bool goback = EINA_TRUE, goforward = EINA_FALSE, escaped = EINA_FALSE;
+   Linkpos p, start, end;
+   char *s = NULL;
+   char endmatch = 0, head[9], tail[9];
+   int g, n = 0, nt = 0, w = 0, h = 0, next = -1;
+   size_t len = 0;
+   Eina_Bool escaped = EINA_FALSE;
 
-   x1 = x2 = cx;
-   y1 = y2 = cy;
+   if (nextr) *nextr = cx + 1;
    termio_size_get(obj, &w, &h);
    if ((w <= 0) || (h <= 0)) return NULL;
-   sc = termio_scroll_get(obj);
+   if ((cx < 0) || (cy < 0) || (cx >= w) || (cy >= h)) return NULL;
+   memset(&p, 0, sizeof(p));
+   p.ty = termio_pty_get(obj);
+   if (!p.ty) return NULL;
+   p.w = w;
+   p.h = h;
+   p.sc = termio_scroll_get(obj);
+   p.x = cx;
+   p.y = cy;
+   termpty_cellcomp_freeze(p.ty);
+   if ((p.x > 0) && (_linkpos_dblwidth_cont(&p))) p.x--;
+   cx = p.x;
+   head[0] = 0;
+   tail[0] = 0;
+   g = _linkpos_char(&p);
+   if ((g == ' ') || (_link_endmatch_get(g))) goto done;
+
+   // back to the start of the word, or of a protocol in it, noting what
+   // quote or bracket opens it. head keeps the text from there on, as far
+   // as a protocol can be long
+   start = p;
    for (;;)
      {
-        s = termio_selection_get(obj, x1, y1 - sc, x2, y2 - sc, &len);
-        if (!s) break;
-        if (goback)
+        g = _linkpos_char(&p);
+        if (g == ' ') break;
+        if (_link_endmatch_get(g))
           {
-             if (link_is_protocol(s))
-               {
-                  goback = EINA_FALSE;
-                  goforward = EINA_TRUE;
-
-                  /* Check if the previous char is a delimiter */
-                  coord_back(&x1, &y1, w, h);
-                  free(s);
-                  s = termio_selection_get(obj, x1, y1 - sc, x2, y2 - sc,
-                                           &len);
-                  if (!s) break;
-                  switch (s[0])
-                    {
-                     case '"': endmatch = '"'; break;
-                     case '\'': endmatch = '\''; break;
-                     case '`': endmatch = '\''; break;
-                     case '<': endmatch = '>'; break;
-                     case '[': endmatch = ']'; break;
-                     case '{': endmatch = '}'; break;
-                     case '(': endmatch = ')'; break;
-                    }
-                  coord_forward(&x1, &y1, w, h);
-
-                  free(s);
-                  s = termio_selection_get(obj, x1, y1 - sc, x2, y2 - sc,
-                                           &len);
-                  if (!s) break;
-               }
-             else
-               {
-                  switch (s[0])
-                    {
-                     case '"': endmatch = '"'; break;
-                     case '\'': endmatch = '\''; break;
-                     case '`': endmatch = '\''; break;
-                     case '<': endmatch = '>'; break;
-                     case '[': endmatch = ']'; break;
-                     case '{': endmatch = '}'; break;
-                     case '(': endmatch = ')'; break;
-                    }
-                  if ((endmatch) || (isspace(s[0])))
-                    {
-                       goback = EINA_FALSE;
-                       coord_forward(&x1, &y1, w, h);
-                       goforward = EINA_TRUE;
-                       free(s);
-                       s = termio_selection_get(obj, x1, y1 - sc, x2, y2 - sc,
-                                                &len);
-                       if (!s) break;
-                    }
-               }
+             endmatch = _link_endmatch_get(g);
+             break;
           }
-        if ((goforward) && (len >= 1))
+        memmove(head + 1, head, sizeof(head) - 2);
+        head[0] = ((g > 0) && (g < 0x80)) ? g : 0x7f;
+        if (n < (int)sizeof(head) - 1) n++;
+        head[n] = 0;
+        // and tail the text right up to the mouse, to catch protocols
+        // starting before it that end after it
+        if ((nextr) && (nt < (int)sizeof(tail) - 1))
           {
-             char end = s[len - 1];
-
-             if ((end == endmatch) ||
-                 ((!escaped) && (isspace(end)) &&
-                  ((end != '\n') || (end != '\r'))))
-               {
-                  goforward = EINA_FALSE;
-                  coord_back(&x2, &y2, w, h);
-                  endmatch = 0;
-               }
-             escaped = (end == '\\');
+             memmove(tail + 1, tail, nt);
+             tail[0] = head[0];
+             tail[++nt] = 0;
           }
-        if ((goback) && (!coord_back(&x1, &y1, w, h)))
+        start = p;
+        if (link_is_protocol(head))
           {
-             goback = EINA_FALSE;
-             goforward = EINA_TRUE;
+             if (_linkpos_back(&p))
+               endmatch = _link_endmatch_get(_linkpos_char(&p));
+             break;
           }
-        if ((goforward) && (!coord_forward(&x2, &y2, w, h)))
+        if (!_linkpos_back(&p)) break;
+     }
+
+   // and on to its end, which a \ can escape a space in
+   p.x = cx;
+   p.y = cy;
+   end = p;
+   for (;;)
+     {
+        g = _linkpos_char(&p);
+        if ((g == endmatch) || ((!escaped) && (g == ' ')))
           {
-             goforward = EINA_FALSE;
+             // the mouse is on what ends it, so it's all behind
+             if ((p.x == cx) && (p.y == cy))
+               {
+                  if ((start.x == cx) && (start.y == cy)) goto done;
+                  if (!_linkpos_back(&end)) goto done;
+               }
+             break;
           }
-        if ((!goback) && (!goforward))
+        if ((nextr) && (next < 0) && (p.y == cy) && (p.x > cx))
           {
-             free(s);
-             s = termio_selection_get(obj, x1, y1 - sc, x2, y2 - sc, &len);
-             break;
+             // hovering there would stop going back at it
+             _link_tail_add(tail, &nt, sizeof(tail) - 1, g);
+             if ((g == ' ') || (_link_endmatch_get(g)) ||
+                 (((g == '/') || (g == ':')) &&
+                  (_link_protocol_ends(tail, nt))))
+               next = p.x;
           }
-        free(s);
-        s = NULL;
+        escaped = (g == '\\');
+        end = p;
+        if (!_linkpos_forward(&p)) break;
      }
+   // so the underline covers all of a double width character at the end
+   p = end;
+   p.x++;
+   if (_linkpos_dblwidth_cont(&p)) end.x = p.x;
+   if (nextr)
+     {
+        if (next >= 0) *nextr = next;
+        else if (end.y > cy) *nextr = w;
+        else if ((end.y == cy) && (end.x > cx)) *nextr = end.x + 1;
+     }
+
+   // only now turn the cells into text, once
+   s = termio_selection_get(obj, start.x, start.y - p.sc,
+                            end.x, end.y - p.sc, &len);
+done:
+   termpty_cellcomp_thaw(p.ty);
    if (s)
      {
-        if ((len > 1) && (!endmatch))
+        if (len > 1)
           {
-             Eina_Bool is_file = _is_file(s);
-
-             if (is_file ||
+             if (_is_file(s) ||
                  link_is_email(s) ||
                  link_is_url(s))
                {
-                  if (x1r) *x1r = x1;
-                  if (y1r) *y1r = y1;
-                  if (x2r) *x2r = x2;
-                  if (y2r) *y2r = y2;
-
-                  if (is_file && (s[0] != '/'))
-                    {
-                       char *ret = _local_path_get(obj, s);
-                       free(s);
-                       return ret;
-                    }
-
+                  if (x1r) *x1r = start.x;
+                  if (y1r) *y1r = start.y;
+                  if (x2r) *x2r = end.x;
+                  if (y2r) *y2r = end.y;
                   return s;
                }
           }
@@ -228,3 +339,264 @@ _termio_link_find(Evas_Object *obj, int cx, int cy,
      }
    return NULL;
 }
+
+// relative paths are taken from the cwd as it is now, not when the link
+// was found, so takes s and returns what to use instead
+static char *
+_link_local_fix(const Evas_Object *obj, char *s)
+{
+   char *ret;
+
+   if ((!s) || (!_is_file(s)) || (s[0] == '/')) return s;
+   ret = _local_path_get(obj, s);
+   free(s);
+   return ret;
+}
+
+char *
+_termio_link_find(Evas_Object *obj, int cx, int cy,
+                  int *x1r, int *y1r, int *x2r, int *y2r)
+{
+   char *s = _link_find(obj, cx, cy, x1r, y1r, x2r, y2r, NULL);
+
+   return _link_local_fix(obj, s);
+}
+
+//// link index
+//
+// what hovering every column of every row of the view finds, worked out in
+// idle time after the row was drawn so hovering only has to look it up. a
+// row's links can run on from rows above or into rows below, so rows joined
+// like that have to be redone together
+
+typedef struct _Termlinkspan Termlinkspan;
+typedef struct _Termlinkrow  Termlinkrow;
+
+// hovering columns from .. to - 1 of the row finds this link
+struct _Termlinkspan
+{
+   char *str; // as it is on screen, paths aren't resolved yet
+   int from, to;
+   int x1, x2;
+   int dy1, dy2; // rows it starts and ends on, relative to the row
+};
+
+struct _Termlinkrow
+{
+   Termlinkspan *spans;
+   int num;
+   int up, down; // how far its links reach above and below it
+   Eina_Bool valid : 1;
+};
+
+struct _Termlinkindex
+{
+   Termlinkrow *rows;
+   int h;
+   int pending; // rows not valid
+};
+
+static void
+_index_row_clear(Termlinkindex *ix, int y)
+{
+   Termlinkrow *row = &(ix->rows[y]);
+   int i;
+
+   for (i = 0; i < row->num; i++) free(row->spans[i].str);
+   free(row->spans);
+   row->spans = NULL;
+   row->num = 0;
+   if (row->valid) ix->pending++;
+   row->valid = EINA_FALSE;
+}
+
+Termlinkindex *
+_termio_link_index_new(void)
+{
+   return calloc(1, sizeof(Termlinkindex));
+}
+
+void
+_termio_link_index_free(Termlinkindex *ix)
+{
+   int y;
+
+   if (!ix) return;
+   for (y = 0; y < ix->h; y++) _index_row_clear(ix, y);
+   free(ix->rows);
+   free(ix);
+}
+
+void
+_termio_link_index_resize(Termlinkindex *ix, int h)
+{
+   Termlinkrow *rows;
+   int y;
+
+   if (!ix) return;
+   for (y = 0; y < ix->h; y++) _index_row_clear(ix, y);
+   rows = calloc(h, sizeof(Termlinkrow));
+   free(ix->rows);
+   ix->rows = rows;
+   ix->h = rows ? h : 0;
+   ix->pending = ix->h;
+}
+
+void
+_termio_link_index_dirty(Termlinkindex *ix, int y)
+{
+   int r;
+
+   if (!ix) return;
+   if (y < 0)
+     {
+        for (r = 0; r < ix->h; r++) _index_row_clear(ix, r);
+        return;
+     }
+   if (y >= ix->h) return;
+   _index_row_clear(ix, y);
+   // the rows next to it may have had a word run on into it, and further
+   // ones links that go through it
+   for (r = y - 1; r >= 0; r--)
+     {
+        if ((r < y - 1) && (ix->rows[r].valid) &&
+            (r + ix->rows[r].down < y))
+          break;
+        _index_row_clear(ix, r);
+     }
+   for (r = y + 1; r < ix->h; r++)
+     {
+        if ((r > y + 1) && (ix->rows[r].valid) &&
+            (r + ix->rows[r].up > y))
+          break;
+        _index_row_clear(ix, r);
+     }
+}
+
+void
+_termio_link_index_shift(Termlinkindex *ix, int y1, int y2, int n)
+{
+   int y, an = abs(n);
+
+   // same rows moving as in the textgrid (see _smart_rows_shift())
+   if (!ix) return;
+   if (y2 >= ix->h) y2 = ix->h - 1;
+   if ((y1 < 0) || (an > (y2 - y1)))
+     {
+        for (y = (y1 < 0) ? 0 : y1; y <= y2; y++)
+          _termio_link_index_dirty(ix, y);
+        return;
+     }
+   if (n == 0) return;
+   if (n < 0)
+     {
+        for (y = y1; y < y1 + an; y++) _index_row_clear(ix, y);
+        memmove(&(ix->rows[y1]), &(ix->rows[y1 + an]),
+                (y2 - y1 + 1 - an) * sizeof(Termlinkrow));
+        memset(&(ix->rows[y2 + 1 - an]), 0, an * sizeof(Termlinkrow));
+     }
+   else
+     {
+        for (y = y2 + 1 - an; y <= y2; y++) _index_row_clear(ix, y);
+        memmove(&(ix->rows[y1 + an]), &(ix->rows[y1]),
+                (y2 - y1 + 1 - an) * sizeof(Termlinkrow));
+        memset(&(ix->rows[y1]), 0, an * sizeof(Termlinkrow));
+     }
+   // the rows moved in are new and the ones at the edges have new
+   // neighbours
+   _termio_link_index_dirty(ix, y1);
+   _termio_link_index_dirty(ix, y2);
+   if (n < 0)
+     {
+        for (y = y2 + 1 - an; y < y2; y++) _termio_link_index_dirty(ix, y);
+     }
+   else
+     {
+        for (y = y1 + 1; y < y1 + an; y++) _termio_link_index_dirty(ix, y);
+     }
+}
+
+static void
+_index_row_do(Termlinkindex *ix, Evas_Object *obj, int y, int w)
+{
+   Termlinkrow *row = &(ix->rows[y]);
+   int x = 0, next;
+
+   while (x < w)
+     {
+        Termlinkspan *spans, *sp;
+        int x1, y1, x2, y2;
+        char *s;
+
+        s = _link_find(obj, x, y, &x1, &y1, &x2, &y2, &next);
+        if (next <= x) next = x + 1;
+        if (!s)
+          {
+             x = next;
+             continue;
+          }
+        spans = realloc(row->spans, (row->num + 1) * sizeof(Termlinkspan));
+        if (!spans)
+          {
+             free(s);
+             break;
+          }
+        row->spans = spans;
+        sp = &(spans[row->num++]);
+        sp->str = s;
+        sp->from = x;
+        sp->to = next;
+        sp->x1 = x1;
+        sp->x2 = x2;
+        sp->dy1 = y1 - y;
+        sp->dy2 = y2 - y;
+        if (sp->dy1 < row->up) row->up = sp->dy1;
+        if (sp->dy2 > row->down) row->down = sp->dy2;
+        x = next;
+     }
+   row->valid = EINA_TRUE;
+   ix->pending--;
+}
+
+Eina_Bool
+_termio_link_index_run(Termlinkindex *ix, Evas_Object *obj, int rows)
+{
+   int y, w = 0, h = 0;
+
+   if ((!ix) || (ix->pending <= 0)) return EINA_FALSE;
+   termio_size_get(obj, &w, &h);
+   for (y = 0; (y < ix->h) && (rows > 0); y++)
+     {
+        if (ix->rows[y].valid) continue;
+        ix->rows[y].up = ix->rows[y].down = 0;
+        _index_row_do(ix, obj, y, w);
+        rows--;
+     }
+   return (ix->pending > 0);
+}
+
+char *
+_termio_link_index_find(Termlinkindex *ix, Evas_Object *obj, int cx, int cy,
+                        int *x1r, int *y1r, int *x2r, int *y2r)
+{
+   Termlinkrow *row;
+   int i;
+
+   if ((!ix) || (cy < 0) || (cy >= ix->h) || (!ix->rows[cy].valid))
+     return _termio_link_find(obj, cx, cy, x1r, y1r, x2r, y2r);
+   row = &(ix->rows[cy]);
+   for (i = 0; i < row->num; i++)
+     {
+        Termlinkspan *sp = &(row->spans[i]);
+
+        if ((cx >= sp->from) && (cx < sp->to))
+          {
+             if (x1r) *x1r = sp->x1;
+             if (y1r) *y1r = cy + sp->dy1;
+             if (x2r) *x2r = sp->x2;
+             if (y2r) *y2r = cy + sp->dy2;
+             return _link_local_fix(obj, strdup(sp->str));
+          }
+     }
+   return NULL;
+}
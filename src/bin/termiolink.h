@@ -1,2 +1,12 @@
+typedef struct _Termlinkindex Termlinkindex;
+
 char *_termio_link_find(Evas_Object *obj, int cx, int cy, int *x1r, int *y1r, int *x2r, int *y2r);
+
+Termlinkindex *_termio_link_index_new(void);
+void           _termio_link_index_free(Termlinkindex *ix);
+void           _termio_link_index_resize(Termlinkindex *ix, int h);
+void           _termio_link_index_dirty(Termlinkindex *ix, int y);
+void           _termio_link_index_shift(Termlinkindex *ix, int y1, int y2, int n);
+Eina_Bool      _termio_link_index_run(Termlinkindex *ix, Evas_Object *obj, int rows);
+char          *_termio_link_index_find(Termlinkindex *ix, Evas_Object *obj, int cx, int cy, int *x1r, int *y1r, int *x2r, int *y2r);
     
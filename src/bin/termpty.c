@@ -4,7 +4,10 @@
 #include "termptyesc.h"
 #include "termptyops.h"
 #include "termptysave.h"
+#include "termptyread.h"
+#include "termptysearch.h"
 #include "termio.h"
+#include "utf8.h"
 #include <sys/types.h>
 #include <signal.h>
 #include <sys/wait.h>
@@ -50,88 +53,18 @@ termpty_shutdown(void)
    _termpty_log_dom = -1;
 }
 
-static void
-_handle_buf(Termpty *ty, const Eina_Unicode *codepoints, int len)
+void
+_termpty_handle_buf(Termpty *ty, const Eina_Unicode *codepoints, int len)
 {
-   Eina_Unicode *c, *ce, *b;
-   int n, bytes;
+   Eina_Unicode *c, *ce;
 
-   c = (int *)codepoints;
+   c = (Eina_Unicode *)codepoints;
    ce = &(c[len]);
 
-   if (ty->buf)
-     {
-        bytes = (ty->buflen + len + 1) * sizeof(int);
-        b = realloc(ty->buf, bytes);
-        if (!b)
-          {
-             ERR("memerr");
-          }
-        INF("realloc add %i + %i", (int)(ty->buflen * sizeof(int)), (int)(len * sizeof(int)));
-        bytes = len * sizeof(Eina_Unicode);
-        memcpy(&(b[ty->buflen]), codepoints, bytes);
-        ty->buf = b;
-        ty->buflen += len;
-        ty->buf[ty->buflen] = 0;
-        c = ty->buf;
-        ce = c + ty->buflen;
-        while (c < ce)
-          {
-             n = _termpty_handle_seq(ty, c, ce);
-             if (n == 0)
-               {
-                  Eina_Unicode *tmp = ty->buf;
-                  ty->buf = NULL;
-                  ty->buflen = 0;
-                  bytes = ((char *)ce - (char *)c) + sizeof(Eina_Unicode);
-                  INF("malloc til %i", (int)(bytes - sizeof(Eina_Unicode)));
-                  ty->buf = malloc(bytes);
-                  if (!ty->buf)
-                    {
-                       ERR("memerr");
-                    }
-                  bytes = (char *)ce - (char *)c;
-                  memcpy(ty->buf, c, bytes);
-                  ty->buflen = bytes / sizeof(Eina_Unicode);
-                  ty->buf[ty->buflen] = 0;
-                  free(tmp);
-                  break;
-               }
-             c += n;
-          }
-        if (c == ce)
-          {
-             if (ty->buf)
-               {
-                  free(ty->buf);
-                  ty->buf = NULL;
-               }
-             ty->buflen = 0;
-          }
-     }
-   else
-     {
-        while (c < ce)
-          {
-             n = _termpty_handle_seq(ty, c, ce);
-             if (n == 0)
-               {
-                  bytes = ((char *)ce - (char *)c) + sizeof(Eina_Unicode);
-                  ty->buf = malloc(bytes);
-                  INF("malloc %i", (int)(bytes - sizeof(Eina_Unicode)));
-                  if (!ty->buf)
-                    {
-                       ERR("memerr");
-                    }
-                  bytes = (char *)ce - (char *)c;
-                  memcpy(ty->buf, c, bytes);
-                  ty->buflen = bytes / sizeof(Eina_Unicode);
-                  ty->buf[ty->buflen] = 0;
-                  break;
-               }
-             c += n;
-          }
-     }
+   // the escape parser keeps its own state across buffers so everything
+   // handed to it is used up, even the start of an unfinished sequence
+   while (c < ce)
+     c += _termpty_handle_seq(ty, c, ce);
 }
 
 static void
@@ -162,6 +95,9 @@ _cb_exe_exit(void *data, int type EINA_UNUSED, void *event)
    ty->hand_exe_exit = NULL;
    if (ty->hand_fd) ecore_main_fd_handler_del(ty->hand_fd);
    ty->hand_fd = NULL;
+   // the reader thread must be gone before the fd is, but whatever it
+   // already decoded still belongs on the screen
+   termpty_reader_stop(ty, EINA_TRUE);
    if (ty->fd >= 0) close(ty->fd);
    ty->fd = -1;
    if (ty->slavefd >= 0) close(ty->slavefd);
@@ -172,93 +108,162 @@ _cb_exe_exit(void *data, int type EINA_UNUSED, void *event)
    return ECORE_CALLBACK_PASS_ON;
 }
 
-static Eina_Bool
-_cb_fd_read(void *data, Ecore_Fd_Handler *fd_handler EINA_UNUSED)
+/* prepend the bytes of an incomplete UTF-8 sequence left over from the
+ * previous chunk, returns the number of bytes put at the start of buf */
+static int
+_oldbuf_take(Termpty *ty, char *buf)
 {
-   Termpty *ty = data;
-   char buf[4097];
-   Eina_Unicode codepoint[4097];
-   int len, i, j, k, reads;
+   int i;
 
-   // read up to 64 * 4096 bytes
-   for (reads = 0; reads < 64; reads++)
-     {
-        char *rbuf = buf;
-        len = sizeof(buf) - 1;
+   for (i = 0; i < (int)sizeof(ty->oldbuf) && ty->oldbuf[i] & 0x80; i++)
+     buf[i] = ty->oldbuf[i];
+   return i;
+}
 
-        for (i = 0; i < (int)sizeof(ty->oldbuf) && ty->oldbuf[i] & 0x80; i++)
-          {
-             *rbuf = ty->oldbuf[i];
-             rbuf++;
-             len--;
-          }
-        len = read(ty->fd, rbuf, len);
-        if (len <= 0) break;
+static void
+_oldbuf_clear(Termpty *ty)
+{
+   int i;
 
+   for (i = 0; i < (int)sizeof(ty->oldbuf); i++)
+     ty->oldbuf[i] = 0;
+}
 
-        for (i = 0; i < (int)sizeof(ty->oldbuf); i++)
-          ty->oldbuf[i] = 0;
+static int
+_utf8_decode(Termpty *ty, char *buf, int len, Eina_Unicode *codepoint)
+{
+   int i, j, k;
 
-        len += rbuf - buf;
+   buf[len] = 0;
+   // convert UTF8 to codepoint integers
+   j = 0;
+   for (i = 0; i < len;)
+     {
+        int g = 0, prev_i = i, n;
 
-        /*
-        printf(" I: ");
-        int jj;
-        for (jj = 0; jj < len; jj++)
+        // nearly everything is plain ascii text - widen that in bulk
+        n = ascii_printable_widen(buf + i, len - i, codepoint + j);
+        if (n > 0)
           {
-             if ((buf[jj] < ' ') || (buf[jj] >= 0x7f))
-               printf("\033[33m%02x\033[0m", (unsigned char)buf[jj]);
-             else
-               printf("%c", buf[jj]);
+             i += n;
+             j += n;
+             continue;
           }
-        printf("\n");
-        */
-        buf[len] = 0;
-        // convert UTF8 to codepoint integers
-        j = 0;
-        for (i = 0; i < len;)
+        if (buf[i])
           {
-             int g = 0, prev_i = i;
-
-             if (buf[i])
-               {
 #if (EINA_VERSION_MAJOR > 1) || (EINA_VERSION_MINOR >= 8)
-                  g = eina_unicode_utf8_next_get(buf, &i);
-                  if ((0xdc80 <= g) && (g <= 0xdcff) &&
-                      (len - prev_i) <= (int)sizeof(ty->oldbuf))
+             g = eina_unicode_utf8_next_get(buf, &i);
+             if ((0xdc80 <= g) && (g <= 0xdcff) &&
+                 (len - prev_i) <= (int)sizeof(ty->oldbuf))
 #else
-                  i = evas_string_char_next_get(buf, i, &g);
-                  if (i < 0 &&
-                      (len - prev_i) <= (int)sizeof(ty->oldbuf))
+             i = evas_string_char_next_get(buf, i, &g);
+             if (i < 0 &&
+                 (len - prev_i) <= (int)sizeof(ty->oldbuf))
 #endif
+               {
+                  for (k = 0;
+                       (k < (int)sizeof(ty->oldbuf)) && 
+                       (k < (len - prev_i));
+                       k++)
                     {
-                       for (k = 0;
-                            (k < (int)sizeof(ty->oldbuf)) && 
-                            (k < (len - prev_i));
-                            k++)
-                         {
-                            ty->oldbuf[k] = buf[prev_i+k];
-                         }
-                       DBG("failure at %d/%d/%d", prev_i, i, len);
-                       break;
+                       ty->oldbuf[k] = buf[prev_i+k];
                     }
+                  DBG("failure at %d/%d/%d", prev_i, i, len);
+                  break;
                }
-             else
-               {
-                  g = 0;
-                  i++;
-               }
-             codepoint[j] = g;
-             j++;
           }
-        codepoint[j] = 0;
-//        DBG("---------------- handle buf %i", j);
-        _handle_buf(ty, codepoint, j);
+        else
+          {
+             g = 0;
+             i++;
+          }
+        codepoint[j] = g;
+        j++;
+     }
+   codepoint[j] = 0;
+   return j;
+}
+
+/* one read() of up to 4096 bytes from the pty, decoded into codepoint
+ * (which must have room for 4097). returns the number of codepoints or
+ * -1 if the read failed (errno is left as read() set it). this is called
+ * from the reader thread too so it must only touch ty->fd and ty->oldbuf */
+int
+_termpty_fd_read(Termpty *ty, Eina_Unicode *codepoint)
+{
+   char buf[4097];
+   int len, old;
+
+   old = _oldbuf_take(ty, buf);
+   len = read(ty->fd, buf + old, sizeof(buf) - 1 - old);
+   if (len <= 0)
+     {
+        if (len == 0) errno = EIO;
+        return -1;
+     }
+
+   _oldbuf_clear(ty);
+
+   len += old;
+
+   /*
+   printf(" I: ");
+   int jj;
+   for (jj = 0; jj < len; jj++)
+     {
+        if ((buf[jj] < ' ') || (buf[jj] >= 0x7f))
+          printf("\033[33m%02x\033[0m", (unsigned char)buf[jj]);
+        else
+          printf("%c", buf[jj]);
+     }
+   printf("\n");
+   */
+   return _utf8_decode(ty, buf, len, codepoint);
+}
+
+static Eina_Bool
+_cb_fd_read(void *data, Ecore_Fd_Handler *fd_handler EINA_UNUSED)
+{
+   Termpty *ty = data;
+   Eina_Unicode codepoint[4097];
+   int len, reads;
+
+   // read up to 64 * 4096 bytes
+   for (reads = 0; reads < 64; reads++)
+     {
+        len = _termpty_fd_read(ty, codepoint);
+        if (len < 0) break;
+//        DBG("---------------- handle buf %i", len);
+        _termpty_handle_buf(ty, codepoint, len);
      }
    if (ty->cb.change.func) ty->cb.change.func(ty->cb.change.data);
    return EINA_TRUE;
 }
 
+void
+termpty_feed(Termpty *ty, const char *input, int len)
+{
+   char buf[4097];
+   Eina_Unicode codepoint[4097];
+   int n, old;
+
+   // same chunking as _cb_fd_read() minus the read() itself
+   while (len > 0)
+     {
+        old = _oldbuf_take(ty, buf);
+        n = sizeof(buf) - 1 - old;
+        if (n > len) n = len;
+        memcpy(buf + old, input, n);
+        input += n;
+        len -= n;
+
+        _oldbuf_clear(ty);
+
+        n = _utf8_decode(ty, buf, n + old, codepoint);
+        _termpty_handle_buf(ty, codepoint, n);
+     }
+}
+
 static void
 _limit_coord(Termpty *ty, Termstate *state)
 {
@@ -269,20 +274,22 @@ _limit_coord(Termpty *ty, Termstate *state)
    if (state->had_cr_y >= ty->h) state->had_cr_y = ty->h - 1;
 }
 
+// all of a pty but the child and the fd to it, which termpty_new() adds.
+// tybench feeds these directly
 Termpty *
-termpty_new(const char *cmd, Eina_Bool login_shell, const char *cd,
-            int w, int h, int backscroll, Eina_Bool xterm_256color,
-            Eina_Bool erase_is_del)
+termpty_new_headless(int w, int h, int backscroll)
 {
    Termpty *ty;
-   const char *pty;
-   int mode;
 
    ty = calloc(1, sizeof(Termpty));
    if (!ty) return NULL;
    ty->w = w;
    ty->h = h;
    ty->backmax = backscroll;
+   // no child, no pty yet - termpty_free() must not kill or close anything
+   ty->fd = -1;
+   ty->slavefd = -1;
+   ty->pid = -1;
 
    _termpty_reset_state(ty);
    ty->save = ty->state;
@@ -300,8 +307,31 @@ termpty_new(const char *cmd, Eina_Bool login_shell, const char *cd,
         ERR("Allocation of term screen2 %ix%i", ty->w, ty->h);
         goto err;
      }
+   // no dirty rows array just means full redraws, so failing is fine
+   ty->dirty.rows = calloc(1, ty->h);
+   ty->dirty.all = 1;
 
    ty->circular_offset = 0;
+   termpty_save_register(ty);
+   return ty;
+err:
+   free(ty->screen);
+   free(ty->screen2);
+   free(ty);
+   return NULL;
+}
+
+Termpty *
+termpty_new(const char *cmd, Eina_Bool login_shell, const char *cd,
+            int w, int h, int backscroll, Eina_Bool xterm_256color,
+            Eina_Bool erase_is_del)
+{
+   Termpty *ty;
+   const char *pty;
+   int mode;
+
+   ty = termpty_new_headless(w, h, backscroll);
+   if (!ty) return NULL;
 
    ty->fd = posix_openpt(O_RDWR | O_NOCTTY);
    if (ty->fd < 0)
@@ -458,28 +488,29 @@ termpty_new(const char *cmd, Eina_Bool login_shell, const char *cd,
           }
         exit(127); /* same as system() for failed commands */
      }
-   ty->hand_fd = ecore_main_fd_handler_add(ty->fd, ECORE_FD_READ,
-                                           _cb_fd_read, ty,
-                                           NULL, NULL);
+   // read + decode on a thread if we can, in the mainloop if we can't
+   if (!termpty_reader_start(ty))
+     ty->hand_fd = ecore_main_fd_handler_add(ty->fd, ECORE_FD_READ,
+                                             _cb_fd_read, ty,
+                                             NULL, NULL);
    close(ty->slavefd);
    ty->slavefd = -1;
    _pty_size(ty);
-   termpty_save_register(ty);
    return ty;
 err:
-   if (ty->screen) free(ty->screen);
-   if (ty->screen2) free(ty->screen2);
-   if (ty->fd >= 0) close(ty->fd);
-   if (ty->slavefd >= 0) close(ty->slavefd);
-   free(ty);
+   termpty_free(ty);
    return NULL;
 }
 
+static void _reflow_drop(Termpty *ty);
+
 void
 termpty_free(Termpty *ty)
 {
    Termexp *ex;
 
+   termpty_reader_stop(ty, EINA_FALSE);
+   _reflow_drop(ty);
    termpty_save_unregister(ty);
    EINA_LIST_FREE(ty->block.expecting, ex) free(ex);
    if (ty->block.blocks) eina_hash_free(ty->block.blocks);
@@ -543,7 +574,9 @@ termpty_free(Termpty *ty)
      }
    if (ty->screen) free(ty->screen);
    if (ty->screen2) free(ty->screen2);
-   if (ty->buf) free(ty->buf);
+   free(ty->dirty.rows);
+   termpty_search_changed(ty, -1);
+   free(ty->longbuf);
    memset(ty, 0, sizeof(Termpty));
    free(ty);
 }
@@ -563,8 +596,6 @@ termpty_cellcomp_thaw(Termpty *ty EINA_UNUSED)
 Termcell *
 termpty_cellrow_get(Termpty *ty, int y, int *wret)
 {
-   Termsave *ts, **tssrc;
-
    if (y >= 0)
      {
         if (y >= ty->h) return NULL;
@@ -573,12 +604,8 @@ termpty_cellrow_get(Termpty *ty, int y, int *wret)
         return &(TERMPTY_SCREEN(ty, 0, y));
      }
    if ((y < -ty->backmax) || !ty->back) return NULL;
-   tssrc = &(ty->back[(ty->backmax + ty->backpos + y) % ty->backmax]);
-   ts = termpty_save_extract(*tssrc);
-   if (!ts) return NULL;
-   *tssrc = ts;
-   *wret = ts->w;
-   return ts->cell;
+   y = (ty->backmax + ty->backpos + y) % ty->backmax;
+   return termpty_save_cells_get(ty, ty->back[y], y, wret);
 }
    
 void
@@ -605,11 +632,149 @@ termpty_line_length(const Termcell *cells, ssize_t nb_cells)
    return 0;
 }
 
+//// reflow
+//
+// a resize rewraps the screen and as much scrollback as it takes to fill
+// the new screen right away. the rest of the scrollback is rewrapped from
+// an idler a bit at a time, going up from the newest line, and the lines it
+// makes are added on top of back[], so lines already there keep their y.
+// another resize before that's done just puts back[] in front of what's
+// still to do, a paragraph never spans two of those.
+
+#define REFLOW_LINES 4096 // old lines rewrapped per idle call
+
+struct _Termreflow
+{
+   Termreflow *next; // older
+   Termsave  **lines; // oldest first
+   int         num; // lines left, the newest at num - 1
+   int         slot; // back[] slot lines[0] was in, frames need it
+   int         w; // width they are wrapped at
+};
+
+static int
+_reflow_num(const Termpty *ty)
+{
+   Termreflow *src;
+   int n = 0;
+
+   for (src = ty->reflow.src; src; src = src->next) n += src->num;
+   return n;
+}
+
+// row y of what is being rewrapped, the screen and then the scrollback
+// left to do going up. *ww is the width it was wrapped at
+static Termcell *
+_reflow_row(Termpty *ty, int y, int *w, int *ww)
+{
+   Termreflow *src;
+   int i = -y - 1;
+
+   if (y >= 0)
+     {
+        *w = *ww = ty->w;
+        return &(TERMPTY_SCREEN(ty, 0, y));
+     }
+   *w = 0;
+   *ww = ty->w;
+   for (src = ty->reflow.src; src; src = src->next)
+     {
+        if (i < src->num) break;
+        i -= src->num;
+     }
+   if (!src) return NULL;
+   i = src->num - 1 - i;
+   *ww = src->w;
+   return termpty_save_cells_get(ty, src->lines[i],
+                                 (src->slot + i) % ty->backmax, w);
+}
+
+// the newest n lines left to do are done
+static void
+_reflow_consume(Termpty *ty, int n)
+{
+   Termreflow *src;
+
+   while ((n > 0) && (ty->reflow.src))
+     {
+        src = ty->reflow.src;
+        termpty_save_free(src->lines[--src->num]);
+        n--;
+        if (src->num > 0) continue;
+        ty->reflow.src = src->next;
+        free(src->lines);
+        free(src);
+     }
+}
+
+static void
+_reflow_drop(Termpty *ty)
+{
+   _reflow_consume(ty, _reflow_num(ty));
+   if (ty->reflow.idler) ecore_idler_del(ty->reflow.idler);
+   ty->reflow.idler = NULL;
+}
+
+// the oldest n lines left to do go, when scrollback is over its memory
+// budget. returns how many did
+int
+_termpty_reflow_evict(Termpty *ty, int n)
+{
+   Termreflow *src, **prev;
+   int i;
+
+   for (prev = &(ty->reflow.src); (*prev) && ((*prev)->next);
+        prev = &((*prev)->next));
+   src = *prev;
+   if (!src) return 0;
+   n = MIN(n, src->num);
+   for (i = 0; i < n; i++) termpty_save_free(src->lines[i]);
+   src->num -= n;
+   memmove(src->lines, src->lines + n, src->num * sizeof(Termsave *));
+   src->slot = (src->slot + n) % ty->backmax;
+   if (src->num <= 0)
+     {
+        *prev = NULL;
+        free(src->lines);
+        free(src);
+     }
+   return n;
+}
+
+// back[] becomes the newest of what's left to do
+static void
+_reflow_push(Termpty *ty)
+{
+   Termreflow *src;
+   int i;
+
+   if ((!ty->back) || (ty->backscroll_num <= 0)) return;
+   src = calloc(1, sizeof(Termreflow));
+   if (!src) return;
+   src->lines = malloc(ty->backscroll_num * sizeof(Termsave *));
+   if (!src->lines)
+     {
+        free(src);
+        return;
+     }
+   src->num = ty->backscroll_num;
+   src->slot = (ty->backpos - ty->backscroll_num + ty->backmax) %
+     ty->backmax;
+   src->w = ty->w;
+   for (i = 0; i < src->num; i++)
+     {
+        src->lines[i] = ty->back[(src->slot + i) % ty->backmax];
+        ty->back[(src->slot + i) % ty->backmax] = NULL;
+     }
+   src->next = ty->reflow.src;
+   ty->reflow.src = src;
+}
+
 static int
 termpty_line_find_top(Termpty *ty, int y_end)
 {
-   int y_start = y_end;
-   Termsave *ts;
+   int y_start = y_end, w, ww, num;
+   Termcell *cells;
 
    while (y_start > 0)
      {
@@ -618,12 +783,11 @@ termpty_line_find_top(Termpty *ty, int y_end)
         else
           return y_start;
      }
-   while (-y_start < ty->backscroll_num)
+   num = _reflow_num(ty);
+   while (-y_start < num)
      {
-        ts = termpty_save_extract(ty->back[(y_start + ty->backpos - 1 +
-                                            ty->backmax) % ty->backmax]);
-        ty->back[(y_start + ty->backpos - 1 + ty->backmax) % ty->backmax] = ts;
-        if (ts->cell[ts->w - 1].att.autowrapped)
+        cells = _reflow_row(ty, y_start - 1, &w, &ww);
+        if ((cells) && (w > 0) && (cells[w - 1].att.autowrapped))
           y_start--;
         else
           return y_start;
@@ -631,28 +795,21 @@ termpty_line_find_top(Termpty *ty, int y_end)
    return y_start;
 }
 
+// the lines go to screen2 and back2, whose newest line is at backpos2 - 1
 static int
 termpty_line_rewrap(Termpty *ty, int y_start, int y_end,
-                    Termcell *screen2, Termsave **back2,
+                    Termcell *screen2, Termsave **back2, int backpos2,
                     int w2, int y2_end)
 {
-   int x, x2, y, y2, y2_start;
+   int x, x2, y, y2, y2_start, w, ww, n;
    int len, len_last, len_remaining, copy_width, ts2_width;
-   Termsave *ts, *ts2;
+   Termsave *ts2;
    Termcell *line, *line2 = NULL;
 
-   if (y_end >= 0)
-     {
-        len_last = termpty_line_length(&TERMPTY_SCREEN(ty, 0, y_end), ty->w);
-     }
-   else
-     {
-        ts = termpty_save_extract(ty->back[(y_end + ty->backpos +
-                                            ty->backmax) % ty->backmax]);
-        ty->back[(y_end + ty->backpos + ty->backmax) % ty->backmax] = ts;
-        len_last = ts->w;
-     }
-   len_remaining = len_last + (y_end - y_start) * ty->w;
+   // a paragraph is wrapped at one width all through
+   line = _reflow_row(ty, y_end, &len_last, &ww);
+   if (y_end >= 0) len_last = termpty_line_length(line, ty->w);
+   len_remaining = len_last + (y_end - y_start) * ww;
    y2_start = y2_end;
    if (len_remaining)
      {
@@ -661,13 +818,14 @@ termpty_line_rewrap(Termpty *ty, int y_start, int y_end,
    else
      {
         if (y2_start < 0)
-          back2[y2_start + ty->backmax] = termpty_save_new(0);
+          back2[(backpos2 + y2_start + ty->backmax) % ty->backmax] =
+            termpty_save_new(0);
         return y2_start;
      }
    if (-y2_start > ty->backmax)
      {
-        y_start += ((-y2_start - ty->backmax) * w2) / ty->w;
-        x = ((-y2_start - ty->backmax) * w2) % ty->w;
+        y_start += ((-y2_start - ty->backmax) * w2) / ww;
+        x = ((-y2_start - ty->backmax) * w2) % ww;
         len_remaining -= (-y2_start - ty->backmax) * w2;
         y2_start = -ty->backmax;
      }
@@ -681,22 +839,13 @@ termpty_line_rewrap(Termpty *ty, int y_start, int y_end,
 
    while (y <= y_end)
      {
-        if (y >= 0)
-          {
-             line = &TERMPTY_SCREEN(ty, 0, y);
-          }
-        else
-          {
-             ts = termpty_save_extract(ty->back[(y + ty->backpos +
-                                                 ty->backmax) % ty->backmax]);
-             ty->back[(y + ty->backpos + ty->backmax) % ty->backmax] = ts;
-             line = ts->cell;
-          }
+        // scrollback rows are shared with the frame cache, so they are
+        // only read and the wrap of the last cell is dropped in the copy
+        line = _reflow_row(ty, y, &w, &ww);
         if (y == y_end)
           len = len_last;
         else
-          len = ty->w;
-        line[len - 1].att.autowrapped = 0;
+          len = ww;
         while (x < len)
           {
              copy_width = MIN(len - x, w2 - x2);
@@ -711,15 +860,23 @@ termpty_line_rewrap(Termpty *ty, int y_start, int y_end,
                        ts2_width = MIN(len_remaining, w2);
                        ts2 = termpty_save_new(ts2_width);
                        line2 = ts2->cell;
-                       back2[y2 + ty->backmax] = ts2;
+                       back2[(backpos2 + y2 + ty->backmax) % ty->backmax] =
+                         ts2;
                     }
                }
              if (line2)
                {
-                  termpty_cell_copy(ty, line + x, line2 + x2, copy_width);
+                  // a wrapped row can be saved shorter than it was
+                  // wrapped at, the cells it lacks are blank
+                  n = MAX(MIN(copy_width, w - x), 0);
+                  termpty_cell_copy(ty, line + x, line2 + x2, n);
+                  if (n < copy_width)
+                    memset(line2 + x2 + n, 0,
+                           (copy_width - n) * sizeof(Termcell));
                   x += copy_width;
                   x2 += copy_width;
                   len_remaining -= copy_width;
+                  if (x == len) line2[x2 - 1].att.autowrapped = 0;
                   if ((x2 == w2) && (y2 != y2_end))
                     {
                        line2[x2 - 1].att.autowrapped = 1;
@@ -734,6 +891,42 @@ termpty_line_rewrap(Termpty *ty, int y_start, int y_end,
    return y2_start;
 }
 
+static Eina_Bool
+_reflow_idler(void *data)
+{
+   Termpty *ty = data;
+   int y_start, y_end = -1, y2_start, y2_end, i, num, backscroll_num;
+
+   termpty_save_freeze();
+   backscroll_num = ty->backscroll_num;
+   num = _reflow_num(ty);
+   while ((-y_end <= num) && (-y_end <= REFLOW_LINES))
+     {
+        // the rest is too old to fit
+        if (ty->backscroll_num >= ty->backmax) break;
+        y_start = termpty_line_find_top(ty, y_end);
+        y2_end = -ty->backscroll_num - 1;
+        y2_start = termpty_line_rewrap(ty, y_start, y_end, NULL, ty->back,
+                                       ty->backpos, ty->w, y2_end);
+        ty->backscroll_num = MAX(ty->backscroll_num, -y2_start);
+        y_end = y_start - 1;
+     }
+   _reflow_consume(ty, -(y_end + 1));
+   if ((!ty->reflow.src) || (ty->backscroll_num >= ty->backmax))
+     {
+        // returning cancel deletes it
+        ty->reflow.idler = NULL;
+        _reflow_drop(ty);
+     }
+   for (i = backscroll_num; i < ty->backscroll_num; i++)
+     termpty_save_changed(ty, (ty->backpos - i - 1 + ty->backmax) %
+                          ty->backmax);
+   termpty_save_thaw();
+   // in case it's scrolled back that far
+   termpty_dirty_all(ty);
+   if (ty->cb.change.func) ty->cb.change.func(ty->cb.change.data);
+   return ty->reflow.idler ? ECORE_CALLBACK_RENEW : ECORE_CALLBACK_CANCEL;
+}
 
 void
 termpty_resize(Termpty *ty, int new_w, int new_h)
@@ -741,7 +934,7 @@ termpty_resize(Termpty *ty, int new_w, int new_h)
    Termcell *new_screen;
    Termsave **new_back;
    int y_start, y_end, new_y_start, new_y_end;
-   int i, altbuf = 0;
+   int altbuf = 0;
 
    if ((ty->w == new_w) && (ty->h == new_h)) return;
    if ((new_w == new_h) && (new_w == 1)) return; // FIXME: something weird is
@@ -768,6 +961,7 @@ termpty_resize(Termpty *ty, int new_w, int new_h)
         ERR("memerr");
      }
    new_back = calloc(sizeof(Termsave *), ty->backmax);
+   _reflow_push(ty);
 
    y_end = ty->state.cy;
    y_start = termpty_line_find_top(ty, y_end);
@@ -787,18 +981,20 @@ termpty_resize(Termpty *ty, int new_w, int new_h)
           }
      }
    y_end = y_start - 1;
-   while ((y_end >= -ty->backscroll_num) && (new_y_end >= -ty->backmax))
+   // the old screen and what fills the new one now, the rest later
+   while ((-y_end <= _reflow_num(ty)) && (new_y_end >= -ty->backmax) &&
+          ((y_end >= 0) || (new_y_end >= 0)))
      {
         y_start = termpty_line_find_top(ty, y_end);
         new_y_start = termpty_line_rewrap(ty, y_start, y_end, new_screen,
-                                        new_back, new_w, new_y_end);
+                                          new_back, 0, new_w, new_y_end);
         y_end = y_start - 1;
         new_y_end = new_y_start - 1;
      }
+   if ((y_end >= 0) || (new_y_end < -ty->backmax)) _reflow_drop(ty);
+   else _reflow_consume(ty, -(y_end + 1));
 
    free(ty->screen);
-   for (i = 1; i <= ty->backscroll_num; i++)
-     termpty_save_free(ty->back[(ty->backpos - i + ty->backmax) % ty->backmax]);
    free(ty->back);
 
    ty->w = new_w;
@@ -810,6 +1006,12 @@ termpty_resize(Termpty *ty, int new_w, int new_h)
    ty->state.had_cr = 0;
    ty->screen = new_screen;
    ty->back = new_back;
+   termpty_save_changed(ty, -1);
+   if ((ty->reflow.src) && (!ty->reflow.idler))
+     ty->reflow.idler = ecore_idler_add(_reflow_idler, ty);
+   free(ty->dirty.rows);
+   ty->dirty.rows = calloc(1, new_h);
+   ty->dirty.all = 1;
 
    if (altbuf) termpty_screen_swap(ty);
 
@@ -830,6 +1032,8 @@ termpty_backscroll_set(Termpty *ty, int size)
    if (ty->backmax == size) return;
    
    termpty_save_freeze();
+   // all of it goes anyway
+   _reflow_drop(ty);
 
    if (ty->back)
      {
@@ -846,6 +1050,7 @@ termpty_backscroll_set(Termpty *ty, int size)
    ty->backscroll_num = 0;
    ty->backpos = 0;
    ty->backmax = size;
+   termpty_save_changed(ty, -1);
    termpty_save_thaw();
 }
 
@@ -998,11 +1203,33 @@ _handle_block_codepoint_overwrite(Termpty *ty, int oldc, int newc)
    _handle_block_codepoint_overwrite_heavy(ty, oldc, newc);
 }
 
+// overwriting cells only has to watch for media block codepoints (see
+// termpty_block_insert()) if a block is alive to be refcounted and one of
+// the cells involved has the block bit. otherwise cells can be moved around
+// in bulk
+static inline Eina_Bool
+_cells_blocks_get(const Termpty *ty, const Termcell *cells, int n, int more)
+{
+   int i;
+
+   if ((!ty->block.blocks) || (!eina_hash_population(ty->block.blocks)))
+     return EINA_FALSE;
+   for (i = 0; i < n; i++) more |= cells[i].codepoint;
+   return !!(more & 0x80000000);
+}
+
 void
 termpty_cell_copy(Termpty *ty, Termcell *src, Termcell *dst, int n)
 {
    int i;
-   
+
+   if (n <= 0) return;
+   if ((!_cells_blocks_get(ty, dst, n, 0)) &&
+       (!_cells_blocks_get(ty, src, n, 0)))
+     {
+        memcpy(dst, src, n * sizeof(Termcell));
+        return;
+     }
    for (i = 0; i < n; i++)
      {
         _handle_block_codepoint_overwrite(ty, dst[i].codepoint, src[i].codepoint);
@@ -1033,16 +1260,52 @@ termpty_screen_swap(Termpty *ty)
    ty->state.appcursor = tmp_appcursor;
 
    ty->altbuf = !ty->altbuf;
+   ty->dirty.all = 1;
 
    if (ty->cb.cancel_sel.func)
      ty->cb.cancel_sel.func(ty->cb.cancel_sel.data);
 }
 
+void
+termpty_dirty_all(Termpty *ty)
+{
+   ty->dirty.all = 1;
+}
+
+Eina_Bool
+termpty_dirty_row_get(const Termpty *ty, int y)
+{
+   if ((ty->dirty.all) || (!ty->dirty.rows)) return EINA_TRUE;
+   if ((y < 0) || (y >= ty->h)) return EINA_FALSE;
+   return ty->dirty.rows[y];
+}
+
+void
+termpty_dirty_clear(Termpty *ty)
+{
+   ty->dirty.all = 0;
+   if (ty->dirty.rows) memset(ty->dirty.rows, 0, ty->h);
+}
+
 void
 termpty_cell_fill(Termpty *ty, Termcell *src, Termcell *dst, int n)
 {
    int i;
 
+   if (n <= 0) return;
+   if (!_cells_blocks_get(ty, dst, n, src ? src[0].codepoint : 0))
+     {
+        Termcell local;
+
+        if (!src)
+          {
+             memset(dst, 0, n * sizeof(Termcell));
+             return;
+          }
+        local = src[0];
+        for (i = 0; i < n; i++) dst[i] = local;
+        return;
+     }
    if (src)
      {
         for (i = 0; i < n; i++)
@@ -1066,7 +1329,12 @@ termpty_cell_codepoint_att_fill(Termpty *ty, int codepoint, Termatt att, Termcel
 {
    Termcell local = { codepoint, att };
    int i;
-   
+
+   if (!_cells_blocks_get(ty, dst, n, codepoint))
+     {
+        for (i = 0; i < n; i++) dst[i] = local;
+        return;
+     }
    for (i = 0; i < n; i++)
      {
         _handle_block_codepoint_overwrite(ty, dst[i].codepoint, codepoint);
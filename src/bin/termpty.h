@@ -8,9 +8,15 @@ typedef struct _Termcell      Termcell;
 typedef struct _Termatt       Termatt;
 typedef struct _Termstate     Termstate;
 typedef struct _Termsave      Termsave;
-typedef struct _Termsavecomp  Termsavecomp;
+typedef struct _Termsaveframe Termsaveframe;
 typedef struct _Termblock     Termblock;
 typedef struct _Termexp       Termexp;
+typedef struct _Termreader    Termreader;
+typedef struct _Termattpal    Termattpal;
+typedef struct _Termspill     Termspill;
+typedef struct _Termreflow    Termreflow;
+typedef struct _Termsearchsig Termsearchsig;
+typedef struct _Termsavesnap  Termsavesnap;
 
 #define COL_DEF        0
 #define COL_BLACK      1
@@ -26,6 +32,11 @@ typedef struct _Termexp       Termexp;
 #define COL_INVERSE   10
 #define COL_INVERSEBG 11
 
+// longest OSC/DCS string payload we hold on to, and the most
+// numeric arguments a CSI sequence can have
+#define TERMPTY_SEQ_MAX 4096
+#define TERMPTY_ESC_ARGS 32
+
 #define MOUSE_OFF              0
 #define MOUSE_X10              1 // Press only
 #define MOUSE_NORMAL           2 // Press+release only
@@ -105,6 +116,7 @@ struct _Termpty
    Evas_Object *obj;
    Ecore_Event_Handler *hand_exe_exit;
    Ecore_Fd_Handler *hand_fd;
+   Termreader *reader;
    struct {
       struct {
          void (*func) (void *data);
@@ -117,15 +129,64 @@ struct _Termpty
    const char *cur_cmd;
    Termcell *screen, *screen2;
    Termsave **back;
+   Termattpal *attpal; // attribute table new frames get packed with
+   Termspill *spill; // file old scrollback is spilled to (see termptysave.c)
+   // scrollback bookkeeping of the compressor (see termptysave.c)
+   struct {
+      int *slots, num, max; // slots decompressed since the last pass
+      int saved; // lines saved right before backpos since the last pass
+      int held; // of those, how many the last pass left for more to come
+      int defrag; // slot the defrag step carries on from
+      unsigned long long lines; // lines ever saved
+      unsigned long long *stamps; // when every 64th of those was saved
+      int stamps_num;
+      long long spilled; // lines before this one went to disk, if they could
+      Eina_Bool all : 1; // back[] was rebuilt, look at all of it
+   } comp;
+   // trigrams in the back[] lines, so searches can skip the ones they
+   // can't match in without decompressing them (see termptysearch.c)
+   struct {
+      Termsearchsig **sigs; // chunks of them, see termptysearch.c
+      int sigs_num;
+      long long lines; // lines ever scrolled off, numbering rows for searches
+      unsigned int gen; // goes up when back[] is rebuilt
+      Eina_Unicode tail[2]; // last characters of the last line saved
+      int tailn;
+   } search;
+   // which screen rows (0 .. h-1) changed since termio last drew them,
+   // relative to the textgrid after termio has applied the scrolls it was
+   // told about. if rows is NULL everything counts as dirty
+   struct {
+      unsigned char *rows;
+      Eina_Bool all : 1;
+   } dirty;
    unsigned char oldbuf[4];
-   int *buf;
-   int buflen;
+   // escape sequence parser state, kept across reads (see termptyesc.c)
+   struct {
+      int args[TERMPTY_ESC_ARGS];
+      int nargs;
+      unsigned char state;
+      unsigned char inter, prefix;
+      Eina_Bool in_arg : 1;
+      Eina_Bool first : 1;
+      Eina_Bool overflow : 1;
+   } esc;
+   // payload of the OSC, DCS or terminology string being collected. only
+   // terminology strings can outgrow buf, they carry on in longbuf
+   Eina_Unicode buf[TERMPTY_SEQ_MAX + 1];
+   Eina_Unicode *longbuf;
+   int buflen, longalloc;
    int w, h;
    int fd, slavefd;
    int circular_offset;
    int circular_offset2;
    int backmax, backpos;
    int backscroll_num;
+   // scrollback left to rewrap after a resize (see termpty.c)
+   struct {
+      Termreflow *src; // newest first
+      Ecore_Idler *idler;
+   } reflow;
    struct {
       int curid;
       Eina_Hash *blocks;
@@ -158,20 +219,28 @@ struct _Termcell
 
 struct _Termsave
 {
-   unsigned int   gen  : 8;
    unsigned int   comp : 1;
    unsigned int   z    : 1;
-   unsigned int   w    : 22;
+   unsigned int   pal  : 1;
+   unsigned int   disk : 1;
+   unsigned int   w    : 20;
    Termcell       cell[1];
 };
 
-struct _Termsavecomp
+// consecutive back[] lines compressed together. each of their slots
+// points at the same frame
+struct _Termsaveframe
 {
-   unsigned int   gen  : 8;
    unsigned int   comp : 1;
    unsigned int   z    : 1;
-   unsigned int   w    : 22; // compressed size in bytes
-   unsigned int   wout; // output width in Termcells
+   unsigned int   pal  : 1; // cells are palette indexed, see termptysave.c
+   unsigned int   disk : 1; // the lz4 data is in the pty's spill file
+   unsigned int   w    : 20; // compressed size in bytes
+   unsigned int   wout; // output width in Termcells, all lines together
+   int            first; // back[] slot of the first line
+   unsigned short num, refs; // lines in it, and slots still pointing at it
+   Termattpal    *attpal; // what pal cells index, a reference
+   unsigned int   off[1]; // num + 1 line starts in wout, lz4 data follows
 };
 
 struct _Termblock
@@ -196,6 +265,11 @@ struct _Termblock
    Eina_Bool    was_active_before : 1;
 };
 
+struct _Termsearchsig
+{
+   unsigned long long bits[4];
+};
+
 struct _Termexp
 {
    int ch, left, id;
@@ -205,6 +279,7 @@ struct _Termexp
 void       termpty_init(void);
 void       termpty_shutdown(void);
 
+Termpty   *termpty_new_headless(int w, int h, int backscroll);
 Termpty   *termpty_new(const char *cmd, Eina_Bool login_shell, const char *cd,
                       int w, int h, int backscroll, Eina_Bool xterm_256color,
                       Eina_Bool erase_is_del);
@@ -213,6 +288,7 @@ void       termpty_cellcomp_freeze(Termpty *ty);
 void       termpty_cellcomp_thaw(Termpty *ty);
 Termcell  *termpty_cellrow_get(Termpty *ty, int y, int *wret);
 void       termpty_write(Termpty *ty, const char *input, int len);
+void       termpty_feed(Termpty *ty, const char *input, int len);
 void       termpty_resize(Termpty *ty, int w, int h);
 void       termpty_backscroll_set(Termpty *ty, int size);
 
@@ -229,6 +305,9 @@ void       termpty_cell_copy(Termpty *ty, Termcell *src, Termcell *dst, int n);
 void       termpty_cell_fill(Termpty *ty, Termcell *src, Termcell *dst, int n);
 void       termpty_cell_codepoint_att_fill(Termpty *ty, int codepoint, Termatt att, Termcell *dst, int n);
 void       termpty_screen_swap(Termpty *ty);
+void       termpty_dirty_all(Termpty *ty);
+Eina_Bool  termpty_dirty_row_get(const Termpty *ty, int y);
+void       termpty_dirty_clear(Termpty *ty);
 
 ssize_t termpty_line_length(const Termcell *cells, ssize_t nb_cells);
 
@@ -1,25 +1,23 @@
-Eina_Bool _termpty_is_dblwidth_slow_get(Termpty *ty, int g);
+// east asian width of every codepoint, see termptydbl.c
+extern const unsigned char _termpty_dblwidth_index[];
+extern const unsigned int _termpty_dblwidth_bits[][16];
 
 static inline Eina_Bool
 _termpty_is_dblwidth_get(Termpty *ty, int g)
 {
 #if defined(SUPPORT_DBLWIDTH)
-   // check for east asian full-width (F), half-width (H), wide (W),
-   // narrow (Na) or ambiguous (A) codepoints
-   // ftp://ftp.unicode.org/Public/UNIDATA/EastAsianWidth.txt
+   unsigned int bits;
 
    // optimize for latin1 non-ambiguous
-   if (g <= 0xa0)
+   if ((g <= 0xa0) || (g > 0x10ffff))
      return EINA_FALSE;
-   // (F)
-   if ((g == 0x3000) ||
-       ((g >= 0xff01) && (g <= 0xff60)) ||
-       ((g >= 0xffe0) && (g <= 0xffe6)))
-     return EINA_TRUE;
-
-   return _termpty_is_dblwidth_slow_get(ty, g);
+   bits = _termpty_dblwidth_bits[_termpty_dblwidth_index[g >> 8]]
+                                [(g >> 4) & 0xf];
+   bits = (bits >> ((g & 0xf) << 1)) & 0x3;
+   // wide (W) and full-width (F) always, ambiguous (A) only if asked to
+   if (ty->state.cjk_ambiguous_wide) return !!bits;
+   return bits & 0x1;
 #else
    return EINA_FALSE;
 #endif
 }
-
@@ -5,6 +5,7 @@
 #include "termptyesc.h"
 #include "termptyops.h"
 #include "termptyext.h"
+#include "utf8.h"
 #if defined(SUPPORT_80_132_COLUMNS)
 #include "termio.h"
 #endif
@@ -25,36 +26,149 @@
 #define BEL 0x07 // Bell
 #define ESC 033 // Escape
 
-/* XXX: all handle_ functions return the number of bytes successfully read, 0
- * if not enought bytes could be read
- */
+//// escape sequence parser
+//
+// a table driven state machine along the lines of Paul Williams' DEC
+// parser (http://vt100.net/emu/dec_ansi_parser). all of its state lives in
+// ty->esc (and the string payload in ty->buf) so a sequence split across
+// reads just carries on where it left off instead of being parsed again
+// from the ESC. CSI numeric arguments are accumulated into ty->esc.args
+// as they arrive.
+//
+// plain text and C0 controls in the ground state don't go through the
+// tables - _termpty_handle_seq() deals with those directly.
 
-static int
-_csi_arg_get(Eina_Unicode **ptr)
+enum
+{
+   ESC_STATE_GROUND, // must be 0 - a calloc()ed Termpty starts here
+   ESC_STATE_ESCAPE, // had ESC
+   ESC_STATE_INTER,  // had ESC + one of ()*+$#@, one more char to go
+   ESC_STATE_CSI,    // ESC [ or 0x9b, collecting args until a final char
+   ESC_STATE_OSC,    // ESC ], string until BEL or ST
+   ESC_STATE_OSC_ESC,// ESC inside OSC, maybe the start of ESC \ (ST)
+   ESC_STATE_TERM,   // ESC }, terminology string until a nul
+   ESC_STATE_DCS,    // ESC P, string until ST
+   ESC_STATE_DCS_ESC // ESC inside DCS, maybe the start of ESC \ (ST)
+};
+
+enum
 {
-   Eina_Unicode *b = *ptr;
-   int sum = 0;
+   ESC_ACT_NONE,
+   ESC_ACT_EXEC,    // C0 control inside a CSI - do it now
+   ESC_ACT_PARAM,   // digit of a CSI argument
+   ESC_ACT_SEP,     // any other CSI argument char - ends the current one
+   ESC_ACT_CSI,     // CSI final char
+   ESC_ACT_ESC,     // ESC + char
+   ESC_ACT_CLEAR,   // start of a CSI or string
+   ESC_ACT_INTER,   // ESC + intermediate
+   ESC_ACT_ESC2,    // ESC + intermediate + char
+   ESC_ACT_PUT,     // string payload char
+   ESC_ACT_PUT_ESC, // ESC in a string that isn't ST - keep it, redo char
+   ESC_ACT_OSC,     // OSC string done
+   ESC_ACT_TERM,    // terminology string done
+   ESC_ACT_DCS      // DCS string done
+};
+
+// low nibble is the action, high nibble the state to go to
+#define T(act, st) (ESC_ACT_##act | (ESC_STATE_##st << 4))
+// codepoints from here on share the table entry of 0x80
+#define ESC_TABLE_SIZE 0xa0
 
-   while ((*b) && (!isdigit(*b))) b++;
-   if (!*b)
+static const unsigned char _esc_table[][ESC_TABLE_SIZE] =
+{
+   [ESC_STATE_ESCAPE] =
      {
-        *ptr = NULL;
-        return 0;
+        [0x00 ... 0x22] = T(ESC, GROUND),
+        ['#' ... '$'] = T(INTER, INTER),
+        [0x25 ... 0x27] = T(ESC, GROUND),
+        ['(' ... '+'] = T(INTER, INTER),
+        [0x2c ... 0x3f] = T(ESC, GROUND),
+        ['@'] = T(INTER, INTER),
+        [0x41 ... 0x4f] = T(ESC, GROUND),
+        ['P'] = T(CLEAR, DCS),
+        [0x51 ... 0x5a] = T(ESC, GROUND),
+        ['['] = T(CLEAR, CSI),
+        ['\\'] = T(ESC, GROUND),
+        [']'] = T(CLEAR, OSC),
+        [0x5e ... 0x7c] = T(ESC, GROUND),
+        ['}'] = T(CLEAR, TERM),
+        [0x7e ... ESC_TABLE_SIZE - 1] = T(ESC, GROUND)
+     },
+   [ESC_STATE_INTER] =
+     {
+        [0x00 ... ESC_TABLE_SIZE - 1] = T(ESC2, GROUND)
+     },
+   [ESC_STATE_CSI] =
+     {
+        [0x00 ... 0x17] = T(EXEC, CSI),
+        [0x18] = T(NONE, GROUND), // CAN
+        [0x19] = T(EXEC, CSI),
+        [0x1a] = T(NONE, GROUND), // SUB
+        [0x1b] = T(NONE, ESCAPE),
+        [0x1c ... 0x1f] = T(EXEC, CSI),
+        [0x20 ... 0x2f] = T(SEP, CSI),
+        ['0' ... '9'] = T(PARAM, CSI),
+        [0x3a ... 0x3f] = T(SEP, CSI),
+        [0x40 ... 0x7e] = T(CSI, GROUND),
+        [0x7f] = T(NONE, CSI),
+        [0x80 ... ESC_TABLE_SIZE - 1] = T(CSI, GROUND)
+     },
+   [ESC_STATE_OSC] =
+     {
+        [0x00 ... 0x06] = T(PUT, OSC),
+        [0x07] = T(OSC, GROUND), // BEL
+        [0x08 ... 0x1a] = T(PUT, OSC),
+        [0x1b] = T(NONE, OSC_ESC),
+        [0x1c ... 0x9b] = T(PUT, OSC),
+        [0x9c] = T(OSC, GROUND), // ST
+        [0x9d ... ESC_TABLE_SIZE - 1] = T(PUT, OSC)
+     },
+   [ESC_STATE_OSC_ESC] =
+     {
+        [0x00 ... 0x5b] = T(PUT_ESC, OSC),
+        ['\\'] = T(OSC, GROUND),
+        [0x5d ... ESC_TABLE_SIZE - 1] = T(PUT_ESC, OSC)
+     },
+   [ESC_STATE_TERM] =
+     {
+        [0x00] = T(TERM, GROUND),
+        [0x01 ... ESC_TABLE_SIZE - 1] = T(PUT, TERM)
+     },
+   [ESC_STATE_DCS] =
+     {
+        [0x00 ... 0x1a] = T(PUT, DCS),
+        [0x1b] = T(NONE, DCS_ESC),
+        [0x1c ... 0x9b] = T(PUT, DCS),
+        [0x9c] = T(DCS, GROUND), // ST
+        [0x9d ... ESC_TABLE_SIZE - 1] = T(PUT, DCS)
+     },
+   [ESC_STATE_DCS_ESC] =
+     {
+        [0x00 ... 0x5b] = T(PUT_ESC, DCS),
+        ['\\'] = T(DCS, GROUND),
+        [0x5d ... ESC_TABLE_SIZE - 1] = T(PUT_ESC, DCS)
      }
-   while (isdigit(*b))
+};
+
+#undef T
+
+/* fetch the next CSI argument, *a is the index of it. once they run out
+ * *a is set to -1 and 0 is returned from then on */
+static int
+_csi_arg_get(Termpty *ty, int *a)
+{
+   if ((*a < 0) || (*a >= ty->esc.nargs))
      {
-        sum *= 10;
-        sum += *b - '0';
-        b++;
+        *a = -1;
+        return 0;
      }
-   *ptr = b;
-   return sum;
+   return ty->esc.args[(*a)++];
 }
 
 static void
-_handle_cursor_control(Termpty *ty, Eina_Unicode *cc)
+_handle_cursor_control(Termpty *ty, Eina_Unicode cc)
 {
-   switch (*cc)
+   switch (cc)
      {
       case 0x07: // BEL '\a' (bell)
          ty->state.had_cr = 0;
@@ -109,23 +223,23 @@ _handle_cursor_control(Termpty *ty, Eina_Unicode *cc)
 }
 
 static void
-_handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
+_handle_esc_csi_color_set(Termpty *ty)
 {
-   Eina_Unicode *b = *ptr;
+   int b = 0;
    int first = 1;
 
-   if (b && (*b == '>'))
+   if (ty->esc.prefix == '>')
      { // key resources used by xterm
         ERR("TODO: set/reset key resources used by xterm");
         return;
      }
    DBG("color set");
-   while (b)
+   while (b >= 0)
      {
-        int arg = _csi_arg_get(&b);
-        if ((first) && (!b))
+        int arg = _csi_arg_get(ty, &b);
+        if ((first) && (b < 0))
           _termpty_reset_att(&(ty->state.att));
-        else if (b)
+        else if (b >= 0)
           {
              first = 0;
              switch (arg)
@@ -203,13 +317,13 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                    break;
                 case 38: // xterm 256 fg color ???
                    // now check if next arg is 5
-                   arg = _csi_arg_get(&b);
+                   arg = _csi_arg_get(ty, &b);
                    if (arg != 5) ERR("Failed xterm 256 color fg esc 5 (got %d)", arg);
                    else
                      {
                         // then get next arg - should be color index 0-255
-                        arg = _csi_arg_get(&b);
-                        if (!b) ERR("Failed xterm 256 color fg esc val");
+                        arg = _csi_arg_get(ty, &b);
+                        if (b < 0) ERR("Failed xterm 256 color fg esc val");
                         else
                           {
                              ty->state.att.fg256 = 1;
@@ -237,13 +351,13 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                    break;
                 case 48: // xterm 256 bg color ???
                    // now check if next arg is 5
-                   arg = _csi_arg_get(&b);
+                   arg = _csi_arg_get(ty, &b);
                    if (arg != 5) ERR("Failed xterm 256 color bg esc 5 (got %d)", arg);
                    else
                      {
                         // then get next arg - should be color index 0-255
-                        arg = _csi_arg_get(&b);
-                        if (!b) ERR("Failed xterm 256 color bg esc val");
+                        arg = _csi_arg_get(ty, &b);
+                        if (b < 0) ERR("Failed xterm 256 color bg esc val");
                         else
                           {
                              ty->state.att.bg256 = 1;
@@ -271,13 +385,13 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                    break;
                 case 98: // xterm 256 fg color ???
                    // now check if next arg is 5
-                   arg = _csi_arg_get(&b);
+                   arg = _csi_arg_get(ty, &b);
                    if (arg != 5) ERR("Failed xterm 256 color fg esc 5 (got %d)", arg);
                    else
                      {
                         // then get next arg - should be color index 0-255
-                        arg = _csi_arg_get(&b);
-                        if (!b) ERR("Failed xterm 256 color fg esc val");
+                        arg = _csi_arg_get(ty, &b);
+                        if (b < 0) ERR("Failed xterm 256 color fg esc val");
                         else
                           {
                              ty->state.att.fg256 = 1;
@@ -305,13 +419,13 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
                    break;
                 case 108: // xterm 256 bg color ???
                    // now check if next arg is 5
-                   arg = _csi_arg_get(&b);
+                   arg = _csi_arg_get(ty, &b);
                    if (arg != 5) ERR("Failed xterm 256 color bg esc 5 (got %d)", arg);
                    else
                      {
                         // then get next arg - should be color index 0-255
-                        arg = _csi_arg_get(&b);
-                        if (!b) ERR("Failed xterm 256 color bg esc val");
+                        arg = _csi_arg_get(ty, &b);
+                        if (b < 0) ERR("Failed xterm 256 color bg esc val");
                         else
                           {
                              ty->state.att.bg256 = 1;
@@ -333,33 +447,20 @@ _handle_esc_csi_color_set(Termpty *ty, Eina_Unicode **ptr)
      }
 }
 
-static int
-_handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
+static void
+_handle_esc_csi(Termpty *ty, Eina_Unicode cc)
 {
-   Eina_Unicode *cc;
-   int arg, i;
-   Eina_Unicode buf[4096], *b;
+   int arg, i, b = 0;
 
-   cc = (Eina_Unicode *)c;
-   b = buf;
-   while ((cc < ce) && (*cc <= '?'))
-     {
-        _handle_cursor_control(ty, cc);
-        *b = *cc;
-        b++;
-        cc++;
-     }
-   if (cc == ce) return 0;
-   *b = 0;
-   b = buf;
-   DBG(" CSI: '%c' args '%s'", *cc, (char *) buf);
-   switch (*cc)
+   DBG(" CSI: '%c' prefix '%c' %i args", cc,
+       ty->esc.prefix ? ty->esc.prefix : ' ', ty->esc.nargs);
+   switch (cc)
      {
       case 'm': // color set
-        _handle_esc_csi_color_set(ty, &b);
+        _handle_esc_csi_color_set(ty);
         break;
       case '@': // insert N blank chars
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, &b);
         if (arg < 1) arg = 1;
         DBG("insert %d blank chars", arg);
           {
@@ -377,7 +478,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         break;
       case 'A': // cursor up N
       case 'e': // cursor up N
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, &b);
         DBG("cursor up %d", arg);
         ty->state.wrapnext = 0;
         ty->state.cy -= arg;
@@ -385,7 +486,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         ty->state.cy = MIN(ty->h - 1, ty->state.cy);
         break;
       case 'B': // cursor down N
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, &b);
         DBG("cursor down %d", arg);
         ty->state.wrapnext = 0;
         ty->state.cy += arg;
@@ -393,7 +494,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         ty->state.cy = MIN(ty->h - 1, ty->state.cy);
         break;
       case 'D': // cursor left N
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, &b);
         if (arg < 1) arg = 1;
         DBG("cursor left %d", arg);
         ty->state.wrapnext = 0;
@@ -405,7 +506,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         break;
       case 'C': // cursor right N
       case 'a': // cursor right N
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, &b);
         if (arg < 1) arg = 1;
         DBG("cursor right %d", arg);
         ty->state.wrapnext = 0;
@@ -419,34 +520,34 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
       case 'f': // cursor pos set
         DBG("cursor pos set");
         ty->state.wrapnext = 0;
-        if (!*b)
+        if (ty->esc.nargs == 0)
           {
              ty->state.cx = 0;
              ty->state.cy = 0;
           }
         else
           {
-             arg = _csi_arg_get(&b);
+             arg = _csi_arg_get(ty, &b);
              if (arg < 1) arg = 1;
              arg--;
              if (arg < 0) arg = 0;
              else if (arg >= ty->h) arg = ty->h - 1;
-             if (b)
+             if (b >= 0)
                {
                   ty->state.cy = arg;
-                  arg = _csi_arg_get(&b);
+                  arg = _csi_arg_get(ty, &b);
                   if (arg < 1) arg = 1;
                   arg--;
                }
              else arg = 0;
              if (arg < 0) arg = 0;
              else if (arg >= ty->w) arg = ty->w - 1;
-             if (b) ty->state.cx = arg;
+             if (b >= 0) ty->state.cx = arg;
           }
         ty->state.cy += ty->state.margin_top;
        break;
       case 'G': // to column N
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, &b);
         if (arg < 1) arg = 1;
         DBG("to column %d", arg);
         ty->state.wrapnext = 0;
@@ -455,7 +556,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         else if (ty->state.cx >= ty->w) ty->state.cx = ty->w - 1;
         break;
       case 'd': // to row N
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, &b);
         if (arg < 1) arg = 1;
         DBG("to row %d", arg);
         ty->state.wrapnext = 0;
@@ -464,7 +565,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         else if (ty->state.cy >= ty->h) ty->state.cy = ty->h - 1;
         break;
       case 'E': // down relative N rows, and to col 0
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, &b);
         if (arg < 1) arg = 1;
         DBG("down relative %d rows, and to col 0", arg);
         ty->state.wrapnext = 0;
@@ -474,7 +575,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         ty->state.cx = 0;
         break;
       case 'F': // up relative N rows, and to col 0
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, &b);
         if (arg < 1) arg = 1;
         DBG("up relative %d rows, and to col 0", arg);
         ty->state.wrapnext = 0;
@@ -484,28 +585,28 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         ty->state.cx = 0;
         break;
       case 'X': // erase N chars
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, &b);
         if (arg < 1) arg = 1;
         DBG("erase %d chars", arg);
         _termpty_clear_line(ty, TERMPTY_CLR_END, arg);
         break;
       case 'S': // scroll up N lines
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, &b);
         if (arg < 1) arg = 1;
         DBG("scroll up %d lines", arg);
         for (i = 0; i < arg; i++) _termpty_text_scroll(ty, EINA_TRUE);
         break;
       case 'T': // scroll down N lines
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, &b);
         if (arg < 1) arg = 1;
         DBG("scroll down %d lines", arg);
         for (i = 0; i < arg; i++) _termpty_text_scroll_rev(ty, EINA_TRUE);
         break;
       case 'M': // delete N lines - cy
       case 'L': // insert N lines - cy
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, &b);
         if (arg < 1) arg = 1;
-        DBG("%s %d lines", (*cc == 'M') ? "delete" : "insert", arg);
+        DBG("%s %d lines", (cc == 'M') ? "delete" : "insert", arg);
           {
              int sy1, sy2;
 
@@ -524,7 +625,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
                }
              for (i = 0; i < arg; i++)
                {
-                  if (*cc == 'M') _termpty_text_scroll(ty, EINA_TRUE);
+                  if (cc == 'M') _termpty_text_scroll(ty, EINA_TRUE);
                   else _termpty_text_scroll_rev(ty, EINA_TRUE);
                }
              ty->state.scroll_y1 = sy1;
@@ -532,7 +633,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
           }
         break;
       case 'P': // erase and scrollback N chars
-        arg = _csi_arg_get(&b);
+        arg = _csi_arg_get(ty, &b);
         if (arg < 1) arg = 1;
         DBG("erase and scrollback %d chars", arg);
           {
@@ -540,6 +641,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
              int x, lim;
 
              cells = &(TERMPTY_SCREEN(ty, 0, ty->state.cy));
+             _termpty_dirty_rows(ty, ty->state.cy, ty->state.cy);
              lim = ty->w - arg;
              for (x = ty->state.cx; x < (ty->w); x++)
                {
@@ -564,7 +666,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         DBG("query device attributes");
           {
              char bf[32];
-             if (b && *b == '>')
+             if (ty->esc.prefix == '>')
                {
                   // Primary device attributes
                   //  0 → VT100
@@ -589,8 +691,8 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         break;
       case 'J': // "2j" erases the screen, 1j erase from screen start to curs, 0j erase cursor to end of screen
         DBG("2j erases the screen, 1j erase from screen start to curs, 0j erase cursor to end of screen");
-        arg = _csi_arg_get(&b);
-        if (b)
+        arg = _csi_arg_get(ty, &b);
+        if (b >= 0)
           {
              if ((arg >= TERMPTY_CLR_END) && (arg <= TERMPTY_CLR_ALL))
                _termpty_clear_screen(ty, arg);
@@ -601,8 +703,8 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         break;
       case 'K': // 0K erase to end of line, 1K erase from screen start to cursor, 2K erase all of line
         DBG("0K erase to end of line, 1K erase from screen start to cursor, 2K erase all of line");
-        arg = _csi_arg_get(&b);
-        if (b)
+        arg = _csi_arg_get(ty, &b);
+        if (b >= 0)
           {
              if ((arg >= TERMPTY_CLR_END) && (arg <= TERMPTY_CLR_ALL))
                _termpty_clear_line(ty, arg, ty->w);
@@ -617,18 +719,14 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
              int mode = 0, priv = 0;
              int handled = 0;
 
-             if (*cc == 'h') mode = 1;
-             if (*b == '?')
-               {
-                  priv = 1;
-                  b++;
-               }
+             if (cc == 'h') mode = 1;
+             if (ty->esc.prefix == '?') priv = 1;
              if (priv) /* DEC Private Mode Reset (DECRST) */
                {
-                  while (b)
+                  while (b >= 0)
                     {
-                       arg = _csi_arg_get(&b);
-                       if (b)
+                       arg = _csi_arg_get(ty, &b);
+                       if (b >= 0)
                          {
                             // complete-ish list here:
                             // http://ttssh2.sourceforge.jp/manual/en/about/ctrlseq.html
@@ -868,10 +966,10 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
                }
              else /* Reset Mode (RM) */
                {
-                  while (b)
+                  while (b >= 0)
                     {
-                       arg = _csi_arg_get(&b);
-                       if (b)
+                       arg = _csi_arg_get(ty, &b);
+                       if (b >= 0)
                          {
                             switch (arg)
                               {
@@ -896,12 +994,12 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
                          }
                     }
                }
-             if (!handled) ERR("unhandled '%c'", *cc);
+             if (!handled) ERR("unhandled '%c'", cc);
           }
         break;
       case 'r':
-        arg = _csi_arg_get(&b);
-        if (!b)
+        arg = _csi_arg_get(ty, &b);
+        if (b < 0)
           {
              WRN("no region args reset region");
              ty->state.scroll_y1 = 0;
@@ -911,8 +1009,8 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
           {
              int arg2;
 
-             arg2 = _csi_arg_get(&b);
-             if (!b)
+             arg2 = _csi_arg_get(ty, &b);
+             if (b < 0)
                {
                   WRN("failed to give 2 regions args reset region");
                   ty->state.scroll_y1 = 0;
@@ -971,7 +1069,7 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
        {
           int idx, size, cx = ty->state.cx, cy = ty->state.cy;
 
-          arg = _csi_arg_get(&b);
+          arg = _csi_arg_get(ty, &b);
           if (arg < 1) arg = 1;
 
           size = ty->w * cy + cx + 1;
@@ -994,42 +1092,32 @@ _handle_esc_csi(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
        }
        break;
       default:
-        ERR("unhandled CSI '%c' (0x%02x)", *cc, *cc);
+        ERR("unhandled CSI '%c' (0x%02x)", cc, cc);
         break;
      }
-   cc++;
-   return cc - c;
 }
 
-static int
-_handle_esc_xterm(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
+// where the string collected for the current sequence is
+static Eina_Unicode *
+_esc_str(Termpty *ty)
 {
-   const Eina_Unicode *cc;
-   Eina_Unicode buf[4096], *b;
+   return ty->longbuf ? ty->longbuf : ty->buf;
+}
+
+static void
+_handle_esc_xterm(Termpty *ty)
+{
+   Eina_Unicode *buf = ty->buf, *txt;
    char *s;
    int len = 0;
-   
-   cc = c;
-   b = buf;
-   while ((cc < ce) && (*cc != ST) && (*cc != BEL))
-     {
-        if ((cc < ce - 1) && (*cc == ESC) && (*(cc + 1) == '\\'))
-          {
-             cc++;
-             break;
-          }
-        *b = *cc;
-        b++;
-        cc++;
-     }
-   *b = 0;
-   if ((*cc == ST) || (*cc == BEL) || (*cc == '\\')) cc++;
-   else return 0;
+
+   // "N;text" - text is whatever comes after the ;
+   txt = (ty->buflen >= 2) ? &(buf[2]) : &(buf[ty->buflen]);
    switch (buf[0])
      {
       case '0':
         // XXX: title + name - callback
-        s = eina_unicode_unicode_to_utf8(&(buf[2]), &len);
+        s = eina_unicode_unicode_to_utf8(txt, &len);
         if (ty->prop.title) eina_stringshare_del(ty->prop.title);
         if (ty->prop.icon) eina_stringshare_del(ty->prop.icon);
         if (s)
@@ -1048,7 +1136,7 @@ _handle_esc_xterm(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         break;
       case '1':
         // XXX: icon name - callback
-        s = eina_unicode_unicode_to_utf8(&(buf[2]), &len);
+        s = eina_unicode_unicode_to_utf8(txt, &len);
         if (ty->prop.icon) eina_stringshare_del(ty->prop.icon);
         if (s)
           {
@@ -1063,7 +1151,7 @@ _handle_esc_xterm(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
         break;
       case '2':
         // XXX: title - callback
-        s = eina_unicode_unicode_to_utf8(&(buf[2]), &len);
+        s = eina_unicode_unicode_to_utf8(txt, &len);
         if (ty->prop.title) eina_stringshare_del(ty->prop.title);
         if (s)
           {
@@ -1079,112 +1167,57 @@ _handle_esc_xterm(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
       case '4':
         // XXX: set palette entry. not supported.
         DBG("set palette, not supported");
-        if ((cc - c) < 3) return 0;
-        b = &(buf[2]);
         break;
       default:
         // many others
         ERR("unhandled xterm esc '%c'", buf[0]);
         break;
      }
-    return cc - c;
 }
 
-static int
-_handle_esc_terminology(Termpty *ty, const Eina_Unicode *c, const Eina_Unicode *ce)
+static void
+_handle_esc_terminology(Termpty *ty)
 {
-   Eina_Unicode *cc;
-   Eina_Unicode *buf, bufsmall[1024], *b;
    char *s;
-   int blen = 0, slen =  0;
+   int slen = 0;
 
-   cc = (Eina_Unicode *)c;
-   while ((cc < ce) && (*cc != 0x0))
-     {
-        blen++;
-        cc++;
-     }
-   buf = bufsmall;
-   if (blen > (int)((sizeof(bufsmall) / sizeof(Eina_Unicode)) - 40))
-     buf = malloc((blen * sizeof(Eina_Unicode)) + 40);
-   cc = (Eina_Unicode *)c;
-   b = buf;
-   while ((cc < ce) && (*cc != 0x0))
-     {
-        *b = *cc;
-        b++;
-        cc++;
-     }
-   if ((cc < ce) && (*cc == 0x0)) cc++;
-   else
-     {
-        if (buf != bufsmall) free(buf);
-        return 0;
-     }
-   *b = 0;
    // commands are stored in the buffer, 0 bytes not allowd (end marker)
-   s = eina_unicode_unicode_to_utf8(buf, &slen);
+   s = eina_unicode_unicode_to_utf8(_esc_str(ty), &slen);
    ty->cur_cmd = s;
-   if (!_termpty_ext_handle(ty, s, buf))
+   if (!_termpty_ext_handle(ty, s, _esc_str(ty)))
      {
         if (ty->cb.command.func) ty->cb.command.func(ty->cb.command.data);
      }
    ty->cur_cmd = NULL;
    free(s);
-   if (buf != bufsmall) free(buf);
-   return cc - c;
 }
 
-static int
-_handle_esc_dcs(Termpty *ty EINA_UNUSED, const Eina_Unicode *c, const Eina_Unicode *ce)
+static void
+_handle_esc_dcs(Termpty *ty)
 {
-   const Eina_Unicode *cc, *be;
-   Eina_Unicode buf[4096], *b;
-   int len = 0;
+   Eina_Unicode *buf = ty->buf;
+   int len = ty->buflen;
 
-   cc = c;
-   b = buf;
-   be = buf + sizeof(buf) / sizeof(buf[0]);
-   while ((cc < ce) && (*cc != ST) && b != be)
-     {
-        if ((cc < ce - 1) && (*cc == ESC) && (*(cc + 1) == '\\'))
-          {
-             cc++;
-             break;
-          }
-        *b = *cc;
-        b++;
-        cc++;
-     }
-   if (b == be)
-     {
-        ERR("dcs parsing overflowed (binary data?)");
-        goto end;
-     }
-   *b = 0;
-   if ((*cc == ST) || (*cc == '\\')) cc++;
-   else return 0;
-   len = cc - c;
    switch (buf[0])
      {
       case '+':
          if (len < 4)
-           goto end;
+           return;
          switch (buf[1])
            {
             case 'q':
               ERR("unhandled dsc request to get termcap/terminfo");
               /* TODO */
-              goto end;
+              return;
                break;
             case 'p':
               ERR("unhandled dsc request to set termcap/terminfo");
               /* TODO */
-              goto end;
+              return;
                break;
             default:
               ERR("invalid dsc request about termcap/terminfo");
-              goto end;
+              return;
            }
          break;
       case '$':
@@ -1192,10 +1225,10 @@ _handle_esc_dcs(Termpty *ty EINA_UNUSED, const Eina_Unicode *c, const Eina_Unico
          if (len > 1 && buf[1] != 'q')
            {
               ERR("invalid/unhandled dsc esc '$%c' (expected '$q')", buf[1]);
-              goto end;
+              return;
            }
          if (len < 4)
-           goto end;
+           return;
          switch (buf[2])
            {
             case '"':
@@ -1208,12 +1241,12 @@ _handle_esc_dcs(Termpty *ty EINA_UNUSED, const Eina_Unicode *c, const Eina_Unico
                else if (buf[3] == 'q') /* DECSCA */
                  {
                     ERR("unhandled DECSCA '$qq'");
-                    goto end;
+                    return;
                  }
                else
                  {
                     ERR("invalid/unhandled dsc esc '$q\"%c'", buf[3]);
-                    goto end;
+                    return;
                  }
                break;
             case 'm': /* SGR */
@@ -1222,7 +1255,7 @@ _handle_esc_dcs(Termpty *ty EINA_UNUSED, const Eina_Unicode *c, const Eina_Unico
                /* TODO: */
             default:
                ERR("unhandled dsc request status string '$q%c'", buf[2]);
-               goto end;
+               return;
            }
          /* TODO */
          break;
@@ -1231,96 +1264,97 @@ _handle_esc_dcs(Termpty *ty EINA_UNUSED, const Eina_Unicode *c, const Eina_Unico
         ERR("unhandled dcs esc '%c'", buf[0]);
         break;
      }
-end:
-   return len;
 }
 
-static int
-_handle_esc(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
+static void
+_handle_esc(Termpty *ty, Eina_Unicode c)
 {
-   int len = ce - c;
-
-   if (len < 1) return 0;
-   DBG("ESC: '%c'", c[0]);
-   switch (c[0])
+   DBG("ESC: '%c'", c);
+   switch (c)
      {
-      case '[':
-        len = _handle_esc_csi(ty, c + 1, ce);
-        if (len == 0) return 0;
-        return 1 + len;
-      case ']':
-        len = _handle_esc_xterm(ty, c + 1, ce);
-        if (len == 0) return 0;
-        return 1 + len;
-      case '}':
-        len = _handle_esc_terminology(ty, c + 1, ce);
-        if (len == 0) return 0;
-        return 1 + len;
-      case 'P':
-        len =  _handle_esc_dcs(ty, c + 1, ce);
-        if (len == 0) return 0;
-        return 1 + len;
       case '=': // set alternate keypad mode
         ty->state.alt_kp = 1;
-        return 1;
+        return;
       case '>': // set numeric keypad mode
         ty->state.alt_kp = 0;
-        return 1;
+        return;
       case 'M': // move to prev line
         ty->state.wrapnext = 0;
         ty->state.cy--;
         _termpty_text_scroll_rev_test(ty, EINA_TRUE);
-        return 1;
+        return;
       case 'D': // move to next line
         ty->state.wrapnext = 0;
         ty->state.cy++;
         _termpty_text_scroll_test(ty, EINA_FALSE);
-        return 1;
+        return;
       case 'E': // add \n\r
         ty->state.wrapnext = 0;
         ty->state.cx = 0;
         ty->state.cy++;
         _termpty_text_scroll_test(ty, EINA_FALSE);
-        return 1;
+        return;
       case 'Z': // same a 'ESC [ Pn c'
         _term_txt_write(ty, "\033[?1;2C");
-        return 1;
+        return;
       case 'c': // reset terminal to initial state
         DBG("reset to init mode and clear");
         _termpty_reset_state(ty);
         _termpty_clear_screen(ty, TERMPTY_CLR_ALL);
         if (ty->cb.cancel_sel.func)
           ty->cb.cancel_sel.func(ty->cb.cancel_sel.data);
-        return 1;
+        return;
+      case '7': // save cursor pos
+        _termpty_cursor_copy(&(ty->state), &(ty->save));
+        return;
+      case '8': // restore cursor pos
+        _termpty_cursor_copy(&(ty->save), &(ty->state));
+        return;
+/*
+      case 'G': // query gfx mode
+        return;
+      case 'H': // set tab at current column
+        return;
+      case 'n': // single shift 2
+        return;
+      case 'o': // single shift 3
+        return;
+ */
+      default:
+        ERR("eek - esc unhandled '%c' (0x%02x)", c, c);
+        return;
+     }
+}
+
+static void
+_handle_esc_inter(Termpty *ty, Eina_Unicode inter, Eina_Unicode c)
+{
+   DBG("ESC: '%c' '%c'", inter, c);
+   switch (inter)
+     {
       case '(': // charset 0
-        if (len < 2) return 0;
-        ty->state.chset[0] = c[1];
+        ty->state.chset[0] = c;
         ty->state.multibyte = 0;
-        ty->state.charsetch = c[1];
-        return 2;
+        ty->state.charsetch = c;
+        return;
       case ')': // charset 1
-        if (len < 2) return 0;
-        ty->state.chset[1] = c[1];
+        ty->state.chset[1] = c;
         ty->state.multibyte = 0;
-        return 2;
+        return;
       case '*': // charset 2
-        if (len < 2) return 0;
-        ty->state.chset[2] = c[1];
+        ty->state.chset[2] = c;
         ty->state.multibyte = 0;
-        return 2;
+        return;
       case '+': // charset 3
-        if (len < 2) return 0;
-        ty->state.chset[3] = c[1];
+        ty->state.chset[3] = c;
         ty->state.multibyte = 0;
-        return 2;
+        return;
       case '$': // charset -2
-        if (len < 2) return 0;
-        ty->state.chset[2] = c[1];
+        ty->state.chset[2] = c;
         ty->state.multibyte = 1;
-        return 2;
+        return;
       case '#': // #8 == test mode -> fill screen with "E";
-        if (len < 2) return 0;
-        if (c[1] == '8')
+        if (c == '8')
           {
              int size;
              Termcell *cells;
@@ -1342,39 +1376,163 @@ _handle_esc(Termpty *ty, const Eina_Unicode *c, Eina_Unicode *ce)
                   termpty_cell_codepoint_att_fill(ty, 'E', att, cells, size);
                }
           }
-        return 2;
+        return;
       case '@': // just consume this plus next char
-        if (len < 2) return 0;
-        return 2;
-      case '7': // save cursor pos
-        _termpty_cursor_copy(&(ty->state), &(ty->save));
-        return 1;
-      case '8': // restore cursor pos
-        _termpty_cursor_copy(&(ty->save), &(ty->state));
-        return 1;
-/*
-      case 'G': // query gfx mode
-        return 2;
-      case 'H': // set tab at current column
-        return 1;
-      case 'n': // single shift 2
-        return 1;
-      case 'o': // single shift 3
-        return 1;
- */
       default:
-        ERR("eek - esc unhandled '%c' (0x%02x)", c[0], c[0]);
-        return 1;
+        return;
+     }
+}
+
+static void
+_esc_clear(Termpty *ty)
+{
+   ty->esc.nargs = 0;
+   ty->esc.prefix = 0;
+   ty->esc.in_arg = 0;
+   ty->esc.first = 1;
+   ty->esc.overflow = 0;
+   ty->buflen = 0;
+   // the odd huge terminology string isn't worth hanging on to
+   free(ty->longbuf);
+   ty->longbuf = NULL;
+   ty->longalloc = 0;
+}
+
+// move a terminology string past TERMPTY_SEQ_MAX to the heap, doubling
+// as it grows and always leaving room for the nul
+static Eina_Bool
+_esc_long_grow(Termpty *ty)
+{
+   Eina_Unicode *tmp;
+   int alloc;
+
+   if (ty->buflen < ty->longalloc - 1) return EINA_TRUE;
+   alloc = ty->longalloc ? ty->longalloc * 2 : (TERMPTY_SEQ_MAX + 1) * 2;
+   tmp = realloc(ty->longbuf, alloc * sizeof(Eina_Unicode));
+   if (!tmp) return EINA_FALSE;
+   if (!ty->longbuf) memcpy(tmp, ty->buf, ty->buflen * sizeof(Eina_Unicode));
+   ty->longbuf = tmp;
+   ty->longalloc = alloc;
+   return EINA_TRUE;
+}
+
+static void
+_esc_put(Termpty *ty, Eina_Unicode c)
+{
+   if (ty->esc.overflow) return;
+   // terminology strings carry file paths and the like and can be any
+   // length, like they always could. OSC and DCS ones are cut off
+   if (ty->buflen >= TERMPTY_SEQ_MAX)
+     {
+        if (ty->esc.state != ESC_STATE_TERM)
+          {
+             ERR("escape string longer than %i, ignored", TERMPTY_SEQ_MAX);
+             ty->esc.overflow = 1;
+             return;
+          }
+        if (!_esc_long_grow(ty))
+          {
+             ERR("no memory for a %i long terminology string", ty->buflen);
+             ty->esc.overflow = 1;
+             return;
+          }
      }
-   return 0;
+   _esc_str(ty)[ty->buflen++] = c;
+}
+
+// nul terminate the collected string, EINA_FALSE if it got cut short
+static Eina_Bool
+_esc_string_end(Termpty *ty)
+{
+   if (ty->esc.overflow) return EINA_FALSE;
+   _esc_str(ty)[ty->buflen] = 0;
+   return EINA_TRUE;
+}
+
+/* run codepoints through the state machine until it gets back to ground
+ * or the input runs out, returns how many were used */
+static int
+_handle_esc_run(Termpty *ty, const Eina_Unicode *c, const Eina_Unicode *ce)
+{
+   const Eina_Unicode *cc;
+   unsigned char t;
+   int *arg;
+
+   for (cc = c; (cc < ce) && (ty->esc.state != ESC_STATE_GROUND); cc++)
+     {
+again:
+        t = _esc_table[ty->esc.state]
+          [(*cc < ESC_TABLE_SIZE) ? *cc : 0x80];
+        ty->esc.state = t >> 4;
+        switch (t & 0xf)
+          {
+           case ESC_ACT_NONE:
+             break;
+           case ESC_ACT_EXEC:
+             _handle_cursor_control(ty, *cc);
+             // fall through - it still ends the current argument
+           case ESC_ACT_SEP:
+             if ((ty->esc.first) && (*cc >= '<') && (*cc <= '?'))
+               ty->esc.prefix = *cc;
+             ty->esc.first = 0;
+             ty->esc.in_arg = 0;
+             break;
+           case ESC_ACT_PARAM:
+             ty->esc.first = 0;
+             if (!ty->esc.in_arg)
+               {
+                  // too many args - the rest are dropped
+                  if (ty->esc.nargs >= TERMPTY_ESC_ARGS) break;
+                  ty->esc.args[ty->esc.nargs++] = 0;
+                  ty->esc.in_arg = 1;
+               }
+             arg = &(ty->esc.args[ty->esc.nargs - 1]);
+             if (*arg < 65536) *arg = (*arg * 10) + (*cc - '0');
+             break;
+           case ESC_ACT_CSI:
+             _handle_esc_csi(ty, *cc);
+             break;
+           case ESC_ACT_ESC:
+             _handle_esc(ty, *cc);
+             break;
+           case ESC_ACT_CLEAR:
+             _esc_clear(ty);
+             break;
+           case ESC_ACT_INTER:
+             ty->esc.inter = *cc;
+             break;
+           case ESC_ACT_ESC2:
+             _handle_esc_inter(ty, ty->esc.inter, *cc);
+             break;
+           case ESC_ACT_PUT:
+             _esc_put(ty, *cc);
+             break;
+           case ESC_ACT_PUT_ESC:
+             _esc_put(ty, ESC);
+             goto again;
+           case ESC_ACT_OSC:
+             if (_esc_string_end(ty)) _handle_esc_xterm(ty);
+             break;
+           case ESC_ACT_TERM:
+             if (_esc_string_end(ty)) _handle_esc_terminology(ty);
+             break;
+           case ESC_ACT_DCS:
+             if (_esc_string_end(ty)) _handle_esc_dcs(ty);
+             break;
+          }
+     }
+   return cc - c;
 }
 
 int
 _termpty_handle_seq(Termpty *ty, Eina_Unicode *c, Eina_Unicode *ce)
 {
-   Eina_Unicode *cc;
    int len = 0;
 
+   // in the middle of a sequence - carry on with it
+   if (ty->esc.state != ESC_STATE_GROUND)
+     return _handle_esc_run(ty, c, ce);
+
 /*   
    printf(" B: ");
    int j;
@@ -1420,7 +1578,7 @@ _termpty_handle_seq(Termpty *ty, Eina_Unicode *c, Eina_Unicode *ce)
            case 0x0b: // VT  '\v' (vertical tab)
            case 0x0c: // FF  '\f' (form feed)
            case 0x0d: // CR  '\r' (carriage ret)
-             _handle_cursor_control(ty, c);
+             _handle_cursor_control(ty, c[0]);
              return 1;
 
            case 0x0e: // SO  (shift out) // Maps G1 character set into GL.
@@ -1459,9 +1617,8 @@ _termpty_handle_seq(Termpty *ty, Eina_Unicode *c, Eina_Unicode *ce)
  */
            case 0x1b: // ESC (escape)
              ty->state.had_cr = 0;
-             len = _handle_esc(ty, c + 1, ce);
-             if (len == 0) return 0;
-             return 1 + len;
+             ty->esc.state = ESC_STATE_ESCAPE;
+             return 1 + _handle_esc_run(ty, c + 1, ce);
 /*
            case 0x1c: // FS  (file separator)
              return 1;
@@ -1488,9 +1645,9 @@ _termpty_handle_seq(Termpty *ty, Eina_Unicode *c, Eina_Unicode *ce)
      {
         ty->state.had_cr = 0;
         DBG("ANSI CSI!!!!!");
-        len = _handle_esc_csi(ty, c + 1, ce);
-        if (len == 0) return 0;
-        return 1 + len;
+        _esc_clear(ty);
+        ty->esc.state = ESC_STATE_CSI;
+        return 1 + _handle_esc_run(ty, c + 1, ce);
      }
    else if ((ty->block.expecting) && (ty->block.on))
      {
@@ -1533,15 +1690,8 @@ _termpty_handle_seq(Termpty *ty, Eina_Unicode *c, Eina_Unicode *ce)
      {
         ty->state.had_cr = 0;
      }
-   cc = (int *)c;
-   DBG("txt: [");
-   while ((cc < ce) && (*cc >= 0x20) && (*cc != 0x7f))
-     {
-        DBG("%c", *cc);
-        cc++;
-        len++;
-     }
-   DBG("]");
+   len = codepoint_printable_run(c, ce - c);
+   DBG("txt: %i", len);
    _termpty_text_append(ty, c, len);
    ty->state.had_cr = 0;
    return len;
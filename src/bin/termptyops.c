@@ -6,6 +6,7 @@
 #include "termptyops.h"
 #include "termptygfx.h"
 #include "termptysave.h"
+#include "termptysearch.h"
 
 #undef CRITICAL
 #undef ERR
@@ -36,24 +37,28 @@ termpty_text_save_top(Termpty *ty, Termcell *cells, ssize_t w_max)
    Termsave *ts;
    ssize_t w;
 
+   // searches number rows by the lines that went off the top, whether
+   // they're kept or not
+   ty->search.lines++;
    if (ty->backmax <= 0) return;
 
    termpty_save_freeze();
    w = termpty_line_length(cells, w_max);
    ts = termpty_save_new(w);
-   termpty_cell_copy(ty, cells, ts->cell, w);
-   if (!ty->back) ty->back = calloc(1, sizeof(Termsave *) * ty->backmax);
-   if (ty->back[ty->backpos])
+   if (!ts)
      {
-        Termsave *ts2;
-        
-        ts2 = termpty_save_extract(ty->back[ty->backpos]);
-        termpty_save_free(ts2);
-        ty->back[ty->backpos] = NULL;
+        termpty_save_thaw();
+        return;
      }
+   termpty_cell_copy(ty, cells, ts->cell, w);
+   if (!ty->back) ty->back = calloc(1, sizeof(Termsave *) * ty->backmax);
+   termpty_search_line_add(ty, ty->backpos, ts->cell, w);
+   // the oldest line goes, no need to decompress it for that
+   termpty_save_free(ty->back[ty->backpos]);
    ty->back[ty->backpos] = ts;
    ty->backpos++;
    if (ty->backpos >= ty->backmax) ty->backpos = 0;
+   termpty_save_added(ty);
    ty->backscroll_num++;
    if (ty->backscroll_num >= ty->backmax) ty->backscroll_num = ty->backmax;
    termpty_save_thaw();
@@ -76,6 +81,7 @@ _termpty_text_scroll(Termpty *ty, Eina_Bool clear)
 
    termio_scroll(ty->obj, -1, start_y, end_y);
    DBG("... scroll!!!!! [%i->%i]", start_y, end_y);
+   _termpty_dirty_scroll(ty, start_y, end_y, -1);
 
    if (start_y == 0 && end_y == ty->h - 1)
      {
@@ -115,6 +121,7 @@ _termpty_text_scroll_rev(Termpty *ty, Eina_Bool clear)
      }
    DBG("... scroll rev!!!!! [%i->%i]", start_y, end_y);
    termio_scroll(ty->obj, 1, start_y, end_y);
+   _termpty_dirty_scroll(ty, start_y, end_y, 1);
 
    if (start_y == 0 && end_y == ty->h - 1)
      {
@@ -168,13 +175,35 @@ _termpty_text_scroll_rev_test(Termpty *ty, Eina_Bool clear)
      }
 }
 
+// how many of codepoints are narrow and fit on the cursor's row from the
+// cursor on, so they can be written in one go
+static int
+_text_run_get(Termpty *ty, const Eina_Unicode *codepoints, int len)
+{
+   int n, max = ty->w - ty->state.cx;
+
+   if (max > len) max = len;
+   for (n = 0; n < max; n++)
+     {
+        Eina_Unicode g;
+
+        g = _termpty_charset_trans(codepoints[n], ty->state.charsetch);
+        if (g & 0x80000000) break;
+#if defined(SUPPORT_DBLWIDTH)
+        if (_termpty_is_dblwidth_get(ty, g)) break;
+#endif
+     }
+   return n;
+}
+
 void
 _termpty_text_append(Termpty *ty, const Eina_Unicode *codepoints, int len)
 {
    Termcell *cells;
-   int i, j;
+   int i, j, n;
 
    termio_content_change(ty->obj, ty->state.cx, ty->state.cy, len);
+   _termpty_dirty_rows(ty, ty->state.cy, ty->state.cy);
 
    cells = &(TERMPTY_SCREEN(ty, 0, ty->state.cy));
    for (i = 0; i < len; i++)
@@ -188,8 +217,40 @@ _termpty_text_append(Termpty *ty, const Eina_Unicode *codepoints, int len)
              ty->state.cx = 0;
              ty->state.cy++;
              _termpty_text_scroll_test(ty, EINA_TRUE);
+             _termpty_dirty_rows(ty, ty->state.cy, ty->state.cy);
              cells = &(TERMPTY_SCREEN(ty, 0, ty->state.cy));
           }
+        // plain text that fits on the row is the common case, so write all
+        // of it at once and in insert mode shift the row once for it.
+        // anything else (wide chars, no autowrap...) goes one at a time
+        if ((ty->state.wrap) && (len - i > 1) &&
+            ((n = _text_run_get(ty, codepoints + i, len - i)) > 1))
+          {
+             Termatt att = ty->state.att;
+             int x = ty->state.cx;
+
+             if (ty->state.insert)
+               {
+                  for (j = ty->w - 1; j >= x + n; j--)
+                    termpty_cell_copy(ty, &(cells[j - n]), &(cells[j]), 1);
+               }
+#if defined(SUPPORT_DBLWIDTH)
+             att.dblwidth = 0;
+#endif
+             termpty_cell_codepoint_att_fill(ty, 0, att, &(cells[x]), n);
+             for (j = 0; j < n; j++)
+               cells[x + j].codepoint =
+                 _termpty_charset_trans(codepoints[i + j], ty->state.charsetch);
+             x += n;
+             if (x >= ty->w)
+               {
+                  ty->state.cx = ty->w - 1;
+                  ty->state.wrapnext = 1;
+               }
+             else ty->state.cx = x;
+             i += n - 1;
+             continue;
+          }
         if (ty->state.insert)
           {
              for (j = ty->w - 1; j > ty->state.cx; j--)
@@ -265,6 +326,7 @@ _termpty_clear_line(Termpty *ty, Termpty_Clear mode, int limit)
    cells = &(TERMPTY_SCREEN(ty, x, y));
    if (n > limit) n = limit;
    termio_content_change(ty->obj, x, y, n);
+   _termpty_dirty_rows(ty, y, y);
    _text_clear(ty, cells, n, 0, EINA_TRUE);
 }
 
@@ -282,6 +344,7 @@ _termpty_clear_screen(Termpty *ty, Termpty_Clear mode)
              int l = ty->h - (ty->state.cy + 1);
 
              termio_content_change(ty->obj, 0, ty->state.cy, l * ty->w);
+             _termpty_dirty_rows(ty, ty->state.cy + 1, ty->h - 1);
 
              while (l)
                {
@@ -298,6 +361,7 @@ _termpty_clear_screen(Termpty *ty, Termpty_Clear mode)
              int y = ty->state.cy + ty->circular_offset;
 
              termio_content_change(ty->obj, 0, 0, ty->state.cy * ty->w);
+             _termpty_dirty_rows(ty, 0, ty->state.cy - 1);
 
              cells = &(TERMPTY_SCREEN(ty, 0, 0));
 
@@ -307,7 +371,7 @@ _termpty_clear_screen(Termpty *ty, Termpty_Clear mode)
                }
              else
                {
-                  int yt = y % ty->w;
+                  int yt = y % ty->h;
                   int yb = ty->h - ty->circular_offset;
 
                   _text_clear(ty, cells, ty->w * yb, 0, EINA_TRUE);
@@ -318,6 +382,7 @@ _termpty_clear_screen(Termpty *ty, Termpty_Clear mode)
         break;
       case TERMPTY_CLR_ALL:
         ty->circular_offset = 0;
+        ty->dirty.all = 1;
         _text_clear(ty, ty->screen, ty->w * ty->h, 0, EINA_TRUE);
         ty->state.scroll_y2 = 0;
         if (ty->cb.cancel_sel.func)
@@ -333,6 +398,48 @@ _termpty_clear_all(Termpty *ty)
 {
    if (!ty->screen) return;
    termpty_cell_fill(ty, NULL, ty->screen, ty->w * ty->h);
+   ty->dirty.all = 1;
+}
+
+void
+_termpty_dirty_rows(Termpty *ty, int y1, int y2)
+{
+   // nothing to do, like clearing below the cursor on the last row
+   if (y1 > y2) return;
+   // the whole screen (a full scroll moving circular_offset, a clear...)
+   // is cheaper to flag once than row by row. cy can also end up past the
+   // bottom with origin mode and TERMPTY_SCREEN() wraps it, so anything
+   // out of range just redraws everything too
+   if ((!ty->dirty.rows) || (y1 < 0) || (y2 >= ty->h) ||
+       ((y1 == 0) && (y2 == (ty->h - 1))))
+     {
+        ty->dirty.all = 1;
+        return;
+     }
+   memset(ty->dirty.rows + y1, 1, y2 - y1 + 1);
+}
+
+void
+_termpty_dirty_scroll(Termpty *ty, int y1, int y2, int direction)
+{
+   // the flags move with the rows so termio can shift the textgrid rows by
+   // the same amount and only redo the one that scrolled in
+   if ((ty->dirty.all) || (!ty->dirty.rows)) return;
+   if ((y1 < 0) || (y2 >= ty->h) || (y1 >= y2))
+     {
+        _termpty_dirty_rows(ty, y1, y2);
+        return;
+     }
+   if (direction < 0)
+     {
+        memmove(ty->dirty.rows + y1, ty->dirty.rows + y1 + 1, y2 - y1);
+        ty->dirty.rows[y2] = 1;
+     }
+   else
+     {
+        memmove(ty->dirty.rows + y1 + 1, ty->dirty.rows + y1, y2 - y1);
+        ty->dirty.rows[y1] = 1;
+     }
 }
 
 void
@@ -12,9 +12,14 @@ void _termpty_text_scroll_rev(Termpty *ty, Eina_Bool clear);
 void _termpty_text_scroll_test(Termpty *ty, Eina_Bool clear);
 void _termpty_text_scroll_rev_test(Termpty *ty, Eina_Bool clear);
 void _termpty_text_append(Termpty *ty, const Eina_Unicode *codepoints, int len);
+void _termpty_handle_buf(Termpty *ty, const Eina_Unicode *codepoints, int len);
+int  _termpty_fd_read(Termpty *ty, Eina_Unicode *codepoint);
+int  _termpty_reflow_evict(Termpty *ty, int n);
 void _termpty_clear_line(Termpty *ty, Termpty_Clear mode, int limit);
 void _termpty_clear_screen(Termpty *ty, Termpty_Clear mode);
 void _termpty_clear_all(Termpty *ty);
+void _termpty_dirty_rows(Termpty *ty, int y1, int y2);
+void _termpty_dirty_scroll(Termpty *ty, int y1, int y2, int direction);
 void _termpty_reset_att(Termatt *att);
 void _termpty_reset_state(Termpty *ty);
 void _termpty_cursor_copy(Termstate *state, Termstate *dest);
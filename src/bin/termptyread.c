@@ -0,0 +1,351 @@
+#include "private.h"
+#include <Elementary.h>
+#include "termpty.h"
+#include "termptyops.h"
+#include "termptyread.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#undef CRITICAL
+#undef ERR
+#undef WRN
+#undef INF
+#undef DBG
+
+#define CRITICAL(...) EINA_LOG_DOM_CRIT(_termpty_log_dom, __VA_ARGS__)
+#define ERR(...)      EINA_LOG_DOM_ERR(_termpty_log_dom, __VA_ARGS__)
+#define WRN(...)      EINA_LOG_DOM_WARN(_termpty_log_dom, __VA_ARGS__)
+#define INF(...)      EINA_LOG_DOM_INFO(_termpty_log_dom, __VA_ARGS__)
+#define DBG(...)      EINA_LOG_DOM_DBG(_termpty_log_dom, __VA_ARGS__)
+
+//// pty reader thread
+//
+// read() and the utf8 decode happen on a thread per pty so a child that
+// floods us doesn't hold the mainloop hostage. the thread pushes decoded
+// codepoints into a single-producer single-consumer ring and pokes the
+// mainloop through a pipe. the mainloop side drains the ring into
+// _termpty_handle_buf() - all terminal state is still only touched from
+// the mainloop. the thread only ever touches ty->fd and ty->oldbuf.
+//
+// head is only written by the mainloop, tail only by the thread. both run
+// freely and are masked when indexing. the only lock is for the thread to
+// sleep on when the ring is full.
+//
+// when the child exits the thread is told to flush: it reads the fd dry
+// while the mainloop keeps draining the ring, so nothing the child wrote
+// last gets lost. only termpty_free() makes it give up on the spot.
+
+#if (EINA_VERSION_MAJOR > 1) || (EINA_VERSION_MINOR >= 8)
+
+#define RING_SIZE  (64 * 1024) // in codepoints, must be a power of 2
+#define RING_MASK  (RING_SIZE - 1)
+
+struct _Termreader
+{
+   Termpty          *ty;
+   Eina_Unicode     *ring;
+   Ecore_Fd_Handler *hand_wake;
+   Eina_Thread       thread;
+   Eina_Lock         lock;
+   Eina_Condition    cond;
+   unsigned int      head, tail;
+   int               wake[2], quit[2];
+   int               notified, waiting, quitting, flushing, done;
+};
+
+static Eina_Bool
+_pipe_open(int fds[2])
+{
+   int i;
+
+   if (pipe(fds) < 0) return EINA_FALSE;
+   for (i = 0; i < 2; i++)
+     {
+        fcntl(fds[i], F_SETFL, O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+     }
+   return EINA_TRUE;
+}
+
+static void
+_pipe_close(int fds[2])
+{
+   if (fds[0] >= 0) close(fds[0]);
+   if (fds[1] >= 0) close(fds[1]);
+   fds[0] = fds[1] = -1;
+}
+
+static void
+_wake(Termreader *rd)
+{
+   char c = 0;
+
+   // only one byte in flight - the mainloop clears notified before it
+   // looks at the ring so nothing pushed after that can be missed
+   if (__atomic_exchange_n(&rd->notified, 1, __ATOMIC_SEQ_CST)) return;
+   if (write(rd->wake[1], &c, 1) < 0)
+     ERR("wake write failed: %s", strerror(errno));
+}
+
+static Eina_Bool
+_ring_wait(Termreader *rd)
+{
+   unsigned int head;
+
+   eina_lock_take(&rd->lock);
+   __atomic_store_n(&rd->waiting, 1, __ATOMIC_SEQ_CST);
+   head = __atomic_load_n(&rd->head, __ATOMIC_SEQ_CST);
+   if (((rd->tail - head) == RING_SIZE) &&
+       (!__atomic_load_n(&rd->quitting, __ATOMIC_SEQ_CST)))
+     eina_condition_wait(&rd->cond);
+   __atomic_store_n(&rd->waiting, 0, __ATOMIC_SEQ_CST);
+   eina_lock_release(&rd->lock);
+   return !__atomic_load_n(&rd->quitting, __ATOMIC_SEQ_CST);
+}
+
+static Eina_Bool
+_ring_push(Termreader *rd, const Eina_Unicode *codepoints, int len)
+{
+   unsigned int head, tail, n, idx, chunk;
+
+   tail = rd->tail;
+   while (len > 0)
+     {
+        head = __atomic_load_n(&rd->head, __ATOMIC_ACQUIRE);
+        n = RING_SIZE - (tail - head);
+        if (n == 0)
+          {
+             // full - the mainloop is behind, wait for it to catch up
+             if (!_ring_wait(rd)) return EINA_FALSE;
+             continue;
+          }
+        if (n > (unsigned int)len) n = len;
+        idx = tail & RING_MASK;
+        chunk = RING_SIZE - idx;
+        if (chunk > n) chunk = n;
+        memcpy(rd->ring + idx, codepoints, chunk * sizeof(Eina_Unicode));
+        memcpy(rd->ring, codepoints + chunk,
+               (n - chunk) * sizeof(Eina_Unicode));
+        tail += n;
+        __atomic_store_n(&rd->tail, tail, __ATOMIC_RELEASE);
+        codepoints += n;
+        len -= n;
+        _wake(rd);
+     }
+   return EINA_TRUE;
+}
+
+// reads whatever the child left in the pty. stops at EAGAIN as something
+// else may still hold the slave open, or at EIO once it is really closed
+static void
+_reader_flush(Termreader *rd, Eina_Unicode *codepoint)
+{
+   int len;
+
+   for (;;)
+     {
+        len = _termpty_fd_read(rd->ty, codepoint);
+        if (len < 0)
+          {
+             if (errno == EINTR) continue;
+             break;
+          }
+        if (!_ring_push(rd, codepoint, len)) break;
+     }
+}
+
+static void *
+_reader_thread(void *data, Eina_Thread t EINA_UNUSED)
+{
+   Termreader *rd = data;
+   Termpty *ty = rd->ty;
+   Eina_Unicode codepoint[4097];
+   struct pollfd pfd[2];
+   char c = 0;
+   int len;
+
+   pfd[0].fd = ty->fd;
+   pfd[0].events = POLLIN;
+   pfd[1].fd = rd->quit[0];
+   pfd[1].events = POLLIN;
+   for (;;)
+     {
+        if (poll(pfd, 2, -1) < 0)
+          {
+             if (errno == EINTR) continue;
+             ERR("poll failed: %s", strerror(errno));
+             break;
+          }
+        if (pfd[1].revents)
+          {
+             if (__atomic_load_n(&rd->flushing, __ATOMIC_SEQ_CST))
+               _reader_flush(rd, codepoint);
+             break;
+          }
+        if (!pfd[0].revents) continue;
+        len = _termpty_fd_read(ty, codepoint);
+        if (len < 0)
+          {
+             if ((errno == EAGAIN) || (errno == EINTR)) continue;
+             // child closed the pty - the exit handler will join us
+             break;
+          }
+        if (!_ring_push(rd, codepoint, len)) break;
+     }
+   // the byte makes sure a flushing mainloop sees done without waiting
+   __atomic_store_n(&rd->done, 1, __ATOMIC_SEQ_CST);
+   if (write(rd->wake[1], &c, 1) < 0)
+     ERR("wake write failed: %s", strerror(errno));
+   return NULL;
+}
+
+// hands at most max codepoints to the parser, returns if some are left
+static Eina_Bool
+_ring_drain(Termreader *rd, int max)
+{
+   unsigned int head, tail, n, idx, chunk;
+
+   head = rd->head;
+   tail = __atomic_load_n(&rd->tail, __ATOMIC_ACQUIRE);
+   n = tail - head;
+   if (n > (unsigned int)max) n = max;
+   while (n > 0)
+     {
+        // the parser copies whatever it can't finish so handing it the
+        // ring memory directly is fine, and so is splitting at the wrap
+        idx = head & RING_MASK;
+        chunk = RING_SIZE - idx;
+        if (chunk > n) chunk = n;
+        _termpty_handle_buf(rd->ty, rd->ring + idx, chunk);
+        head += chunk;
+        n -= chunk;
+        __atomic_store_n(&rd->head, head, __ATOMIC_SEQ_CST);
+     }
+   if (__atomic_load_n(&rd->waiting, __ATOMIC_SEQ_CST))
+     {
+        eina_lock_take(&rd->lock);
+        eina_condition_signal(&rd->cond);
+        eina_lock_release(&rd->lock);
+     }
+   return (head != __atomic_load_n(&rd->tail, __ATOMIC_ACQUIRE));
+}
+
+static Eina_Bool
+_cb_wake(void *data, Ecore_Fd_Handler *fd_handler EINA_UNUSED)
+{
+   Termreader *rd = data;
+   Termpty *ty = rd->ty;
+   char buf[64];
+
+   while (read(rd->wake[0], buf, sizeof(buf)) > 0);
+   __atomic_store_n(&rd->notified, 0, __ATOMIC_SEQ_CST);
+   // same budget as reading in the mainloop had: 64 * 4096. if there is
+   // more, poke ourselves so the rest waits until after a render
+   if (_ring_drain(rd, 64 * 4096)) _wake(rd);
+   if (ty->cb.change.func) ty->cb.change.func(ty->cb.change.data);
+   return EINA_TRUE;
+}
+
+static void
+_reader_free(Termreader *rd)
+{
+   if (rd->hand_wake) ecore_main_fd_handler_del(rd->hand_wake);
+   _pipe_close(rd->wake);
+   _pipe_close(rd->quit);
+   eina_condition_free(&rd->cond);
+   eina_lock_free(&rd->lock);
+   free(rd->ring);
+   free(rd);
+}
+
+Eina_Bool
+termpty_reader_start(Termpty *ty)
+{
+   Termreader *rd;
+
+   if ((ty->reader) || (ty->fd < 0)) return EINA_FALSE;
+   rd = calloc(1, sizeof(Termreader));
+   if (!rd) return EINA_FALSE;
+   rd->ty = ty;
+   rd->wake[0] = rd->wake[1] = rd->quit[0] = rd->quit[1] = -1;
+   eina_lock_new(&rd->lock);
+   eina_condition_new(&rd->cond, &rd->lock);
+   rd->ring = malloc(RING_SIZE * sizeof(Eina_Unicode));
+   if ((!rd->ring) || (!_pipe_open(rd->wake)) || (!_pipe_open(rd->quit)))
+     goto err;
+   rd->hand_wake = ecore_main_fd_handler_add(rd->wake[0], ECORE_FD_READ,
+                                             _cb_wake, rd, NULL, NULL);
+   if (!rd->hand_wake) goto err;
+   if (!eina_thread_create(&rd->thread, EINA_THREAD_NORMAL, -1,
+                           _reader_thread, rd))
+     goto err;
+   ty->reader = rd;
+   return EINA_TRUE;
+err:
+   ERR("cannot start pty reader thread, reading in mainloop");
+   _reader_free(rd);
+   return EINA_FALSE;
+}
+
+void
+termpty_reader_stop(Termpty *ty, Eina_Bool flush)
+{
+   Termreader *rd = ty->reader;
+   char c = 0;
+
+   if (!rd) return;
+   if (flush) __atomic_store_n(&rd->flushing, 1, __ATOMIC_SEQ_CST);
+   else
+     {
+        __atomic_store_n(&rd->quitting, 1, __ATOMIC_SEQ_CST);
+        eina_lock_take(&rd->lock);
+        eina_condition_signal(&rd->cond);
+        eina_lock_release(&rd->lock);
+     }
+   if (write(rd->quit[1], &c, 1) < 0)
+     ERR("quit write failed: %s", strerror(errno));
+   if (flush)
+     {
+        struct pollfd pfd;
+        char buf[64];
+
+        // keep emptying the ring so the thread can push all it reads
+        pfd.fd = rd->wake[0];
+        pfd.events = POLLIN;
+        while (!__atomic_load_n(&rd->done, __ATOMIC_SEQ_CST))
+          {
+             __atomic_store_n(&rd->notified, 0, __ATOMIC_SEQ_CST);
+             if (_ring_drain(rd, RING_SIZE)) continue;
+             if (poll(&pfd, 1, -1) > 0)
+               while (read(rd->wake[0], buf, sizeof(buf)) > 0);
+          }
+     }
+   eina_thread_join(rd->thread);
+   ty->reader = NULL;
+   if (flush)
+     {
+        while (_ring_drain(rd, RING_SIZE));
+        if (ty->cb.change.func) ty->cb.change.func(ty->cb.change.data);
+     }
+   _reader_free(rd);
+}
+
+#else
+
+// no Eina_Thread - termpty.c reads in the mainloop instead
+Eina_Bool
+termpty_reader_start(Termpty *ty EINA_UNUSED)
+{
+   return EINA_FALSE;
+}
+
+void
+termpty_reader_stop(Termpty *ty EINA_UNUSED, Eina_Bool flush EINA_UNUSED)
+{
+}
+
+#endif
@@ -0,0 +1,2 @@
+Eina_Bool termpty_reader_start(Termpty *ty);
+void      termpty_reader_stop(Termpty *ty, Eina_Bool flush);
@@ -1,9 +1,15 @@
 #include "private.h"
 #include <Elementary.h>
 #include "termpty.h"
+#include "termptyops.h"
 #include "termptysave.h"
+#include "termptysearch.h"
 #include "lz4/lz4.h"
 #include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
 
 #if defined (__MacOSX__) || (defined (__MACH__) && defined (__APPLE__))
 # ifndef MAP_ANONYMOUS
@@ -14,277 +20,1553 @@
 #define MEM_PAGE_SIZE    4096
 #define MEM_ALLOC_ALIGN  16
 #define MEM_BLOCK_PAGES  32
-#define MEM_BLOCKS       1024
+#define MEM_BLOCK_SIZE   (MEM_BLOCK_PAGES * MEM_PAGE_SIZE) // a power of 2
 
 typedef struct _Alloc Alloc;
 
+// blocks are MEM_BLOCK_SIZE aligned with this at the start, so the block
+// an allocation lives in is its address masked
 struct _Alloc
 {
    int size, last, count;
-   short slot;
-   unsigned char gen;
-   unsigned char __pad;
+   int live; // bytes still allocated, the rest up to last are holes
+   int slot;
 };
 
-static unsigned char cur_gen = 0;
-static Alloc *alloc[MEM_BLOCKS] =  { 0 };
+// block header sized up so allocations stay MEM_ALLOC_ALIGN aligned
+#define MEM_ALLOC_HDR \
+   (MEM_ALLOC_ALIGN * ((sizeof(Alloc) + MEM_ALLOC_ALIGN - 1) / MEM_ALLOC_ALIGN))
+
+static Alloc **alloc = NULL; // grows as needed, _mem_defrag() packs it
+static int alloc_num = 0, alloc_max = 0;
+static Alloc *alloc_open = NULL; // block being filled
+static size_t mem_live = 0; // bytes allocated over all blocks, and counted in
+static size_t mem_budget = 256 * 1024 * 1024; // see _mem_evict()
+
+static Alloc *
+_alloc_block_new(void)
+{
+   unsigned char *ptr, *al;
+   size_t sz = MEM_BLOCK_SIZE;
+   int i;
+
+   // only happens every few hundred lines, so looking for a slot is fine
+   for (i = 0; i < alloc_num; i++)
+     {
+        if (!alloc[i]) break;
+     }
+   if (i == alloc_max)
+     {
+        Alloc **tmp = realloc(alloc, (alloc_max + 256) * sizeof(Alloc *));
+
+        if (!tmp) return NULL;
+        alloc = tmp;
+        alloc_max += 256;
+     }
+
+   // get mmaped anonymous memory so when freed it goes away from the system.
+   // twice the size so an aligned block fits, and the rest is given back
+   ptr = mmap(NULL, sz * 2, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (ptr == MAP_FAILED) return NULL;
+   al = (unsigned char *)(((size_t)ptr + sz - 1) & ~(sz - 1));
+   if (al > ptr) munmap(ptr, al - ptr);
+   if ((al + sz) < (ptr + (sz * 2))) munmap(al + sz, (ptr + (sz * 2)) - (al + sz));
+
+   // note - we SHOULD memset to 0, but we are assuming mmap anon give 0 pages
+   if (i == alloc_num) alloc_num++;
+   alloc[i] = (Alloc *)al;
+   alloc[i]->size = sz;
+   alloc[i]->last = MEM_ALLOC_HDR;
+   alloc[i]->slot = i;
+   return alloc[i];
+}
+
+static void *
+_alloc_new(int size)
+{
+   Alloc *al = alloc_open;
+   unsigned char *ptr;
+   int newsize;
+
+   // allocations sized up to nearest size alloc alignment
+   newsize = MEM_ALLOC_ALIGN * ((size + MEM_ALLOC_ALIGN - 1) / MEM_ALLOC_ALIGN);
+   if (newsize > (MEM_BLOCK_SIZE - (int)MEM_ALLOC_HDR)) return NULL;
+   // the rest of a block too full for this is left unused
+   if ((!al) || ((al->size - al->last) < newsize))
+     {
+        al = _alloc_block_new();
+        if (!al) return NULL;
+        alloc_open = al;
+     }
+   ptr = (unsigned char *)al;
+   ptr += al->last;
+   al->last += newsize;
+   al->count++;
+   al->live += newsize;
+   mem_live += newsize;
+   return ptr;
+}
+
+static void
+_alloc_free(Alloc *al, int size)
+{
+   size = MEM_ALLOC_ALIGN * ((size + MEM_ALLOC_ALIGN - 1) / MEM_ALLOC_ALIGN);
+   al->live -= size;
+   mem_live -= size;
+   al->count--;
+   if (al->count > 0) return;
+   if (alloc_open == al) alloc_open = NULL;
+   alloc[al->slot] = NULL;
+   munmap(al, al->size);
+}
+
+static Alloc *
+_alloc_find(void *mem)
+{
+   Alloc *al = (Alloc *)((size_t)mem & ~((size_t)MEM_BLOCK_SIZE - 1));
+
+   if ((al->slot < 0) || (al->slot >= alloc_num) || (alloc[al->slot] != al))
+     return NULL;
+   return al;
+}
 
 static void *
-_alloc_new(int size, unsigned char gen)
+_mem_new(int size)
+{
+   void *ptr;
+   
+   if (!size) return NULL;
+   ptr = _alloc_new(size);
+   return ptr;
+}
+
+static void
+_mem_free(void *ptr, int size)
+{
+   Alloc *al;
+   
+   if (!ptr) return;
+   al = _alloc_find(ptr);
+   if (!al)
+     {
+        ERR("Cannot find %p in alloc blocks", ptr);
+        return;
+     }
+   _alloc_free(al, size);
+}
+
+static void
+_mem_defrag(void)
+{
+   int i, j = 0;
+
+   for (i = 0; i < alloc_num; i++)
+     {
+        if (alloc[i])
+          {
+             alloc[j] = alloc[i];
+             alloc[j]->slot = j;
+             j++;
+          }
+     }
+   alloc_num = j;
+   if (!alloc_num)
+     {
+        free(alloc);
+        alloc = NULL;
+        alloc_max = 0;
+     }
+}
+
+//// attribute palette
+//
+// scrollback tends to use a handful of attribute combinations, so when a
+// line is compressed its attributes are interned in a per-pty table and
+// each cell is stored as codepoint << ATT_PAL_BITS | index - half the size
+// of a Termcell before lz4 even sees it. lines with codepoints that don't
+// fit (blocks) or that need a new attribute once the table is full are
+// stored as plain Termcells like before.
+//
+// a full table isn't added to again. the next pass starts a new one and
+// the old one stays around only as long as frames packed with it do, so
+// scrollback that keeps changing colours doesn't end up all unpacked. the
+// worker only fills tables in, references are counted in the mainloop.
+
+#define ATT_PAL_BITS  11
+#define ATT_PAL_MAX   (1 << ATT_PAL_BITS)
+#define ATT_PAL_MASK  (ATT_PAL_MAX - 1)
+#define ATT_HASH_SIZE (ATT_PAL_MAX * 2) // so it's never more than half full
+#define ATT_CP_MAX    (1U << (32 - ATT_PAL_BITS))
+
+struct _Termattpal
+{
+   Termatt        att[ATT_PAL_MAX];
+   unsigned short hash[ATT_HASH_SIZE]; // index + 1, 0 == empty slot
+   int            num;
+   int            refs; // the pty while it's current, jobs and frames
+};
+
+static int
+_attpal_index(Termattpal *pal, const Termatt *att)
+{
+   const unsigned char *p = (const unsigned char *)att;
+   unsigned int h = 0, i;
+
+   for (i = 0; i < sizeof(Termatt); i++) h = (h * 31) + p[i];
+   for (h &= (ATT_HASH_SIZE - 1); pal->hash[h];
+        h = (h + 1) & (ATT_HASH_SIZE - 1))
+     {
+        i = pal->hash[h] - 1;
+        if (!memcmp(&(pal->att[i]), att, sizeof(Termatt))) return i;
+     }
+   if (pal->num >= ATT_PAL_MAX) return -1;
+   pal->att[pal->num] = *att;
+   pal->hash[h] = pal->num + 1;
+   // the mainloop looks at num to see when it's full
+   __atomic_store_n(&pal->num, pal->num + 1, __ATOMIC_RELEASE);
+   return pal->num - 1;
+}
+
+static Termattpal *
+_attpal_ref(Termattpal *pal)
+{
+   if (pal) pal->refs++;
+   return pal;
+}
+
+static void
+_attpal_unref(Termattpal *pal)
+{
+   if ((pal) && (--pal->refs == 0)) free(pal);
+}
+
+// the table new jobs of ty pack into, a fresh one once the last is full
+static Termattpal *
+_attpal_get(Termpty *ty)
+{
+   if ((ty->attpal) &&
+       (__atomic_load_n(&ty->attpal->num, __ATOMIC_ACQUIRE) >= ATT_PAL_MAX))
+     {
+        _attpal_unref(ty->attpal);
+        ty->attpal = NULL;
+     }
+   if (!ty->attpal)
+     ty->attpal = _attpal_ref(calloc(1, sizeof(Termattpal)));
+   return ty->attpal;
+}
+
+static Eina_Bool
+_attpal_cells_pack(Termattpal *pal, const Termcell *cells, unsigned int *out,
+                   int n)
+{
+   const Termatt *prev = NULL;
+   int i, idx = 0;
+
+   if (!pal) return EINA_FALSE;
+   for (i = 0; i < n; i++)
+     {
+        if ((unsigned int)cells[i].codepoint >= ATT_CP_MAX) return EINA_FALSE;
+        // runs of the same attributes are the norm - skip the hash for them
+        if ((!prev) || (memcmp(prev, &(cells[i].att), sizeof(Termatt))))
+          {
+             idx = _attpal_index(pal, &(cells[i].att));
+             if (idx < 0) return EINA_FALSE;
+             prev = &(cells[i].att);
+          }
+        out[i] = ((unsigned int)cells[i].codepoint << ATT_PAL_BITS) | idx;
+     }
+   return EINA_TRUE;
+}
+
+static void
+_attpal_cells_unpack(const Termattpal *pal, const unsigned int *in,
+                     Termcell *cells, int n)
+{
+   int i;
+
+   for (i = 0; i < n; i++)
+     {
+        cells[i].codepoint = in[i] >> ATT_PAL_BITS;
+        cells[i].att = pal->att[in[i] & ATT_PAL_MASK];
+     }
+}
+
+static int ts_comp = 0;
+static int ts_uncomp = 0;
+static int ts_freeops = 0;
+static int ts_compfreeze = 0;
+static int freeze = 0;
+static Eina_List *ptys = NULL;
+static Ecore_Idler *idler = NULL;
+static Ecore_Timer *timer = NULL;
+
+//// compressor thread
+//
+// a compressor pass on the mainloop only copies uncompressed lines into
+// jobs, a frame's worth each. lz4 (and the palette packing) run on a worker
+// thread and the results come back through a pipe to be swapped into back[]
+// by the mainloop again, so the allocator and back[] stay mainloop only. a
+// line can change or go away while its job is out, so a result is only
+// used if all its lines still hold exactly what was compressed.
+
+#define FRAME_LINES 32   // lines compressed together at most
+#define FRAME_CELLS 8192 // Termcells in a frame at most, so it fits a block
+
+typedef struct _Compjob Compjob;
+
+struct _Compjob
+{
+   Compjob      *next;
+   Termpty      *ty;
+   Termattpal   *attpal; // what the worker packs with, a reference
+   char         *out; // lz4 output, filled in by the worker
+   int           slot, num, bytes; // back[] slot of the first line, lines
+   Eina_Bool     pal : 1;
+   unsigned int  off[FRAME_LINES + 1]; // where each line starts in cells
+   Termcell      cells[1]; // copy of the lines as they were queued
+};
+
+typedef struct _Compqueue Compqueue;
+
+struct _Compqueue
+{
+   Compjob *head, *tail;
+};
+
+#define COMP_BATCH 256 // jobs the worker takes per lock
+
+static int comp_pending = 0; // jobs queued and not applied yet
+
+static int
+_frame_size(int num, int bytes)
+{
+   return sizeof(Termsaveframe) + (num * sizeof(unsigned int)) + bytes;
+}
+
+static char *
+_frame_data(Termsaveframe *fr)
+{
+   return (char *)(&(fr->off[fr->num + 1]));
+}
+
+static void
+_job_run(Compjob *job)
+{
+   unsigned int *packed;
+   char *src;
+   int n = job->off[job->num], srcbytes;
+
+   packed = malloc((n + 1) * sizeof(unsigned int));
+   job->pal = ((packed) &&
+               (_attpal_cells_pack(job->attpal, job->cells, packed, n)));
+   if (job->pal)
+     {
+        src = (char *)packed;
+        srcbytes = n * sizeof(unsigned int);
+     }
+   else
+     {
+        src = (char *)(&(job->cells[0]));
+        srcbytes = n * sizeof(Termcell);
+     }
+   job->out = malloc(LZ4_compressBound(srcbytes));
+   if (job->out) job->bytes = LZ4_compress(src, job->out, srcbytes);
+   else job->bytes = -1;
+   free(packed);
+}
+
+static void
+_job_apply(Compjob *job)
+{
+   Termpty *ty = job->ty;
+   Termsave *ts;
+   Termsaveframe *fr;
+   int i, slot;
+
+   if ((job->bytes < 0) || (!ty->back) || (job->slot >= ty->backmax) ||
+       (job->num > ty->backmax))
+     return;
+   for (i = 0; i < job->num; i++)
+     {
+        ts = ty->back[(job->slot + i) % ty->backmax];
+        // scrolled out, resized or looked at since it was queued - if a line
+        // doesn't hold exactly what got compressed the result is useless
+        if ((!ts) || (ts->z) ||
+            (ts->w != (job->off[i + 1] - job->off[i])) ||
+            (memcmp(ts->cell, job->cells + job->off[i],
+                    ts->w * sizeof(Termcell))))
+          return;
+     }
+   fr = _mem_new(_frame_size(job->num, job->bytes));
+   if (!fr)
+     {
+        ERR("Big problem. Can't allocate backscroll compress buffer");
+        return;
+     }
+   fr->comp = 1;
+   fr->z = 1;
+   fr->pal = job->pal;
+   fr->attpal = job->pal ? _attpal_ref(job->attpal) : NULL;
+   fr->w = job->bytes;
+   fr->wout = job->off[job->num];
+   fr->first = job->slot;
+   fr->num = fr->refs = job->num;
+   memcpy(fr->off, job->off, (job->num + 1) * sizeof(unsigned int));
+   memcpy(_frame_data(fr), job->out, job->bytes);
+   ts_compfreeze++;
+   for (i = 0; i < job->num; i++)
+     {
+        slot = (job->slot + i) % ty->backmax;
+        termpty_save_free(ty->back[slot]);
+        ty->back[slot] = (Termsave *)fr;
+     }
+   ts_compfreeze--;
+   ts_uncomp -= job->num;
+   ts_comp += job->num;
+}
+
+static void
+_job_free(Compjob *job)
+{
+   _attpal_unref(job->attpal);
+   free(job->out);
+   free(job);
+}
+
+static void
+_queue_push(Compqueue *q, Compjob *job)
+{
+   job->next = NULL;
+   if (q->tail) q->tail->next = job;
+   else q->head = job;
+   q->tail = job;
+}
+
+static void _check_compressor(Eina_Bool frozen);
+static void _mem_evict(void);
+
+#if (EINA_VERSION_MAJOR > 1) || (EINA_VERSION_MINOR >= 8)
+
+static void
+_queue_append(Compqueue *q, Compqueue *q2)
+{
+   if (!q2->head) return;
+   if (q->tail) q->tail->next = q2->head;
+   else q->head = q2->head;
+   q->tail = q2->tail;
+   q2->head = q2->tail = NULL;
+}
+
+// drops all jobs of ty from q, returns how many
+static int
+_queue_purge(Compqueue *q, Termpty *ty)
+{
+   Compjob *job, *prev = NULL, *next;
+   int n = 0;
+
+   for (job = q->head; job; job = next)
+     {
+        next = job->next;
+        if (job->ty != ty)
+          {
+             prev = job;
+             continue;
+          }
+        if (prev) prev->next = next;
+        else q->head = next;
+        if (q->tail == job) q->tail = prev;
+        _job_free(job);
+        n++;
+     }
+   return n;
+}
+
+// everything but "on" is only touched with the lock held
+static struct {
+   Eina_Thread       thread;
+   Eina_Lock         lock;
+   Eina_Condition    cond;
+   Compqueue         todo, done;
+   Ecore_Fd_Handler *hand_wake;
+   int               wake[2];
+   Eina_Bool         on;
+   Eina_Bool         busy;
+   Eina_Bool         quit;
+   Eina_Bool         notified;
+} comp = { .wake = { -1, -1 } };
+
+static void *
+_comp_thread(void *data EINA_UNUSED, Eina_Thread t EINA_UNUSED)
+{
+   Compqueue batch;
+   Compjob *job;
+   char c = 0;
+   int n;
+
+   eina_lock_take(&comp.lock);
+   for (;;)
+     {
+        while ((!comp.todo.head) && (!comp.quit))
+          eina_condition_wait(&comp.cond);
+        if (comp.quit) break;
+        batch.head = batch.tail = comp.todo.head;
+        for (n = 1; (n < COMP_BATCH) && (batch.tail->next); n++)
+          batch.tail = batch.tail->next;
+        comp.todo.head = batch.tail->next;
+        if (!comp.todo.head) comp.todo.tail = NULL;
+        batch.tail->next = NULL;
+        comp.busy = EINA_TRUE;
+        eina_lock_release(&comp.lock);
+
+        for (job = batch.head; job; job = job->next) _job_run(job);
+
+        eina_lock_take(&comp.lock);
+        comp.busy = EINA_FALSE;
+        _queue_append(&comp.done, &batch);
+        // flush and unregister may be waiting for this batch
+        eina_condition_broadcast(&comp.cond);
+        if (!comp.notified)
+          {
+             comp.notified = EINA_TRUE;
+             if (write(comp.wake[1], &c, 1) < 0)
+               ERR("compressor wake write failed: %s", strerror(errno));
+          }
+     }
+   eina_lock_release(&comp.lock);
+   return NULL;
+}
+
+static void
+_comp_apply(void)
+{
+   Compjob *job, *next;
+
+   if ((freeze) || (!comp.on)) return;
+   eina_lock_take(&comp.lock);
+   job = comp.done.head;
+   comp.done.head = comp.done.tail = NULL;
+   comp.notified = EINA_FALSE;
+   eina_lock_release(&comp.lock);
+   if (!job) return;
+   for (; job; job = next)
+     {
+        next = job->next;
+        _job_apply(job);
+        _job_free(job);
+        comp_pending--;
+     }
+   // the pass is done once everything is compressed
+   if (!comp_pending) _mem_evict();
+   _check_compressor(EINA_FALSE);
+}
+
+static Eina_Bool
+_cb_comp_wake(void *data EINA_UNUSED, Ecore_Fd_Handler *fd_handler EINA_UNUSED)
+{
+   char buf[64];
+
+   while (read(comp.wake[0], buf, sizeof(buf)) > 0);
+   _comp_apply();
+   return EINA_TRUE;
+}
+
+static void
+_comp_start(void)
+{
+   int i;
+
+   if (comp.on) return;
+   if (pipe(comp.wake) < 0) goto err;
+   for (i = 0; i < 2; i++)
+     {
+        fcntl(comp.wake[i], F_SETFL, O_NONBLOCK);
+        fcntl(comp.wake[i], F_SETFD, FD_CLOEXEC);
+     }
+   comp.hand_wake = ecore_main_fd_handler_add(comp.wake[0], ECORE_FD_READ,
+                                              _cb_comp_wake, NULL,
+                                              NULL, NULL);
+   if (!comp.hand_wake) goto err;
+   eina_lock_new(&comp.lock);
+   eina_condition_new(&comp.cond, &comp.lock);
+   comp.quit = EINA_FALSE;
+   if (!eina_thread_create(&comp.thread, EINA_THREAD_BACKGROUND, -1,
+                           _comp_thread, NULL))
+     {
+        eina_condition_free(&comp.cond);
+        eina_lock_free(&comp.lock);
+        goto err;
+     }
+   comp.on = EINA_TRUE;
+   return;
+err:
+   ERR("cannot start scrollback compressor thread, compressing in mainloop");
+   if (comp.hand_wake) ecore_main_fd_handler_del(comp.hand_wake);
+   comp.hand_wake = NULL;
+   if (comp.wake[0] >= 0) close(comp.wake[0]);
+   if (comp.wake[1] >= 0) close(comp.wake[1]);
+   comp.wake[0] = comp.wake[1] = -1;
+}
+
+static void
+_comp_stop(void)
+{
+   Compjob *job;
+
+   if (!comp.on) return;
+   eina_lock_take(&comp.lock);
+   comp.quit = EINA_TRUE;
+   eina_condition_broadcast(&comp.cond);
+   eina_lock_release(&comp.lock);
+   eina_thread_join(comp.thread);
+   comp.on = EINA_FALSE;
+   // only called once the last pty is gone, so nothing is left to apply to
+   while ((job = comp.todo.head))
+     {
+        comp.todo.head = job->next;
+        _job_free(job);
+     }
+   while ((job = comp.done.head))
+     {
+        comp.done.head = job->next;
+        _job_free(job);
+     }
+   comp.todo.tail = comp.done.tail = NULL;
+   comp_pending = 0;
+   comp.notified = EINA_FALSE;
+   eina_condition_free(&comp.cond);
+   eina_lock_free(&comp.lock);
+   ecore_main_fd_handler_del(comp.hand_wake);
+   comp.hand_wake = NULL;
+   close(comp.wake[0]);
+   close(comp.wake[1]);
+   comp.wake[0] = comp.wake[1] = -1;
+}
+
+static void
+_comp_submit(Compqueue *q)
+{
+   Compjob *job, *next;
+
+   if (!comp.on)
+     {
+        for (job = q->head; job; job = next)
+          {
+             next = job->next;
+             _job_run(job);
+             _job_apply(job);
+             _job_free(job);
+          }
+        q->head = q->tail = NULL;
+        return;
+     }
+   for (job = q->head; job; job = job->next) comp_pending++;
+   eina_lock_take(&comp.lock);
+   _queue_append(&comp.todo, q);
+   eina_condition_broadcast(&comp.cond);
+   eina_lock_release(&comp.lock);
+}
+
+static void
+_comp_wait(void)
+{
+   if (!comp.on) return;
+   eina_lock_take(&comp.lock);
+   while ((comp.todo.head) || (comp.busy))
+     eina_condition_wait(&comp.cond);
+   eina_lock_release(&comp.lock);
+   _comp_apply();
+}
+
+static void
+_comp_purge(Termpty *ty)
+{
+   if (!comp.on) return;
+   eina_lock_take(&comp.lock);
+   comp_pending -= _queue_purge(&comp.todo, ty);
+   // the batch being worked on may have some of ty's jobs
+   while (comp.busy)
+     eina_condition_wait(&comp.cond);
+   comp_pending -= _queue_purge(&comp.done, ty);
+   eina_lock_release(&comp.lock);
+}
+
+#else
+
+// no Eina_Thread - compress in the mainloop like we always did
+static void _comp_start(void) {}
+static void _comp_stop(void) {}
+static void _comp_apply(void) {}
+static void _comp_wait(void) {}
+static void _comp_purge(Termpty *ty EINA_UNUSED) {}
+
+static void
+_comp_submit(Compqueue *q)
+{
+   Compjob *job, *next;
+
+   for (job = q->head; job; job = next)
+     {
+        next = job->next;
+        _job_run(job);
+        _job_apply(job);
+        _job_free(job);
+     }
+   q->head = q->tail = NULL;
+}
+
+#endif
+
+// queues num lines from slot on, all uncompressed, as frames
+static void
+_frame_queue(Compqueue *q, Termpty *ty, int slot, int num)
+{
+   Compjob *job;
+   Termsave *ts;
+   int i, n, cells;
+
+   while (num > 0)
+     {
+        // as many lines as fit, but always at least one
+        for (n = 0, cells = 0; (n < num) && (n < FRAME_LINES); n++)
+          {
+             ts = ty->back[(slot + n) % ty->backmax];
+             if ((n > 0) && ((cells + (int)ts->w) > FRAME_CELLS)) break;
+             cells += ts->w;
+          }
+        job = malloc(sizeof(Compjob) + (cells * sizeof(Termcell)));
+        if (!job) return;
+        job->ty = ty;
+        job->out = NULL;
+        job->slot = slot;
+        job->num = n;
+        job->bytes = -1;
+        job->pal = EINA_FALSE;
+        job->attpal = _attpal_ref(_attpal_get(ty));
+        for (i = 0, cells = 0; i < n; i++)
+          {
+             ts = ty->back[(slot + i) % ty->backmax];
+             job->off[i] = cells;
+             memcpy(job->cells + cells, ts->cell, ts->w * sizeof(Termcell));
+             cells += ts->w;
+          }
+        job->off[n] = cells;
+        _queue_push(q, job);
+        slot = (slot + n) % ty->backmax;
+        num -= n;
+     }
+}
+
+// queues the uncompressed ones of num slots from slot on, neighbours
+// together
+static void
+_range_queue(Compqueue *q, Termpty *ty, int slot, int num)
+{
+   Termsave *ts;
+   int i, start = -1;
+
+   for (i = 0; i <= num; i++)
+     {
+        ts = (i < num) ? ty->back[(slot + i) % ty->backmax] : NULL;
+        if ((ts) && (!ts->z))
+          {
+             if (start < 0) start = i;
+          }
+        else if (start >= 0)
+          {
+             _frame_queue(q, ty, (slot + start) % ty->backmax, i - start);
+             start = -1;
+          }
+     }
+}
+
+static int
+_slot_cmp(const void *a, const void *b)
+{
+   return *((const int *)a) - *((const int *)b);
+}
+
+// only lines saved or decompressed since the last pass can need compressing,
+// so that's all that gets looked at - not the whole of back[]
+static void
+_walk_pty(Termpty *ty, Compqueue *q)
+{
+   int i, j, n, keep = 0, *slots = ty->comp.slots;
+
+   if (!ty->back) goto done;
+   if (ty->comp.all)
+     {
+        _range_queue(q, ty, 0, ty->backmax);
+        goto done;
+     }
+   // new lines go in whole frames, the few left over wait for more. if
+   // none came since the last pass there may be no more, so they go as
+   // a short frame rather than sit there uncompressed
+   n = MIN(ty->comp.saved, ty->backmax);
+   keep = n % FRAME_LINES;
+   if (n == ty->comp.held) keep = 0;
+   _range_queue(q, ty, (ty->backpos - n + ty->backmax) % ty->backmax,
+                n - keep);
+   for (i = 0, j = 0; i < ty->comp.num; i++)
+     {
+        if (slots[i] >= ty->backmax) continue;
+        // saved again since it was decompressed - that's the new lines
+        if (((ty->backpos - slots[i] + ty->backmax - 1) % ty->backmax) < n)
+          continue;
+        slots[j++] = slots[i];
+     }
+   // decompressed lines with any decompressed neighbours
+   qsort(slots, j, sizeof(int), _slot_cmp);
+   for (i = 0; i < j; i = n)
+     {
+        for (n = i + 1; (n < j) && (slots[n] <= (slots[n - 1] + 1)); n++);
+        _range_queue(q, ty, slots[i], slots[n - 1] - slots[i] + 1);
+     }
+done:
+   ty->comp.saved = ty->comp.held = keep;
+   ty->comp.num = 0;
+   ty->comp.all = 0;
+}
+
+//// spill file
+//
+// with the disk store on, frames that would get evicted go to a temporary
+// file of their pty instead (see _spill_pty()) and only their header and
+// line offsets stay in memory. the file is used in SPILL_SEG segments that
+// get reused once the frames in them are gone, and is read through a
+// mapping of it, so a spilled row is paged back in when it's looked at.
+
+#define SPILL_SEG (4 * 1024 * 1024) // bigger than any frame
+
+struct _Termspill
+{
+   int fd;
+   char *map; // read only, all segs segments of the file
+   int *live; // bytes of frames still in each segment
+   int segs;
+   int seg, pos; // segment being filled and how far
+   int frames; // spilled frames pointing here
+   Eina_Bool gone : 1; // its pty went away, this goes with the last frame
+   Eina_Bool broken : 1; // writing failed, the rest gets evicted instead
+};
+
+// where the data of a spilled frame went, in place of the data
+typedef struct _Spillref Spillref;
+
+struct _Spillref
+{
+   Termspill *spill;
+   long long pos;
+};
+
+static Eina_Bool spill_on = EINA_FALSE;
+
+static void _frame_forget(Termsaveframe *fr);
+
+static Termspill *
+_spill_new(void)
+{
+   Termspill *sp;
+   const char *dir = getenv("TMPDIR");
+   char buf[PATH_MAX];
+
+   sp = calloc(1, sizeof(Termspill));
+   if (!sp) return NULL;
+   sp->seg = -1;
+   if ((!dir) || (!dir[0])) dir = "/tmp";
+   snprintf(buf, sizeof(buf), "%s/terminology-scrollback-XXXXXX", dir);
+   sp->fd = mkstemp(buf);
+   if (sp->fd < 0)
+     {
+        ERR("cannot create scrollback file in %s: %s", dir, strerror(errno));
+        sp->broken = 1;
+        return sp;
+     }
+   // nobody needs it by name, and this way it goes when we do
+   unlink(buf);
+   fcntl(sp->fd, F_SETFD, FD_CLOEXEC);
+   return sp;
+}
+
+static void
+_spill_unmap(Termspill *sp)
+{
+   if (sp->map) munmap(sp->map, (size_t)sp->segs * SPILL_SEG);
+   sp->map = NULL;
+}
+
+static void
+_spill_free(Termspill *sp)
+{
+   _spill_unmap(sp);
+   if (sp->fd >= 0) close(sp->fd);
+   free(sp->live);
+   free(sp);
+}
+
+// nothing in the file anymore, give the disk space back
+static void
+_spill_empty(Termspill *sp)
+{
+   _spill_unmap(sp);
+   if ((sp->fd >= 0) && (ftruncate(sp->fd, 0) < 0))
+     ERR("cannot truncate scrollback file: %s", strerror(errno));
+   free(sp->live);
+   sp->live = NULL;
+   sp->segs = 0;
+   sp->seg = -1;
+   sp->pos = 0;
+}
+
+// file position for bytes more, or -1
+static long long
+_spill_alloc(Termspill *sp, int bytes)
+{
+   int *tmp;
+   int i;
+   void *map;
+
+   if ((sp->seg < 0) || ((sp->pos + bytes) > SPILL_SEG))
+     {
+        for (i = 0; i < sp->segs; i++)
+          {
+             if ((i != sp->seg) && (!sp->live[i])) break;
+          }
+        if (i == sp->segs)
+          {
+             tmp = realloc(sp->live, (sp->segs + 1) * sizeof(int));
+             if (!tmp) return -1;
+             sp->live = tmp;
+             sp->live[sp->segs] = 0;
+             if (ftruncate(sp->fd, (off_t)(sp->segs + 1) * SPILL_SEG) < 0)
+               {
+                  ERR("cannot grow scrollback file: %s", strerror(errno));
+                  sp->broken = 1;
+                  return -1;
+               }
+             map = mmap(NULL, (size_t)(sp->segs + 1) * SPILL_SEG, PROT_READ,
+                        MAP_SHARED, sp->fd, 0);
+             if (map == MAP_FAILED)
+               {
+                  ERR("cannot map scrollback file: %s", strerror(errno));
+                  sp->broken = 1;
+                  return -1;
+               }
+             _spill_unmap(sp);
+             sp->map = map;
+             sp->segs++;
+          }
+        sp->seg = i;
+        sp->pos = 0;
+     }
+   sp->pos += bytes;
+   sp->live[sp->seg] += bytes;
+   return ((long long)sp->seg * SPILL_SEG) + sp->pos - bytes;
+}
+
+static void
+_spill_release(Termspill *sp, long long pos, int bytes)
+{
+   sp->live[pos / SPILL_SEG] -= bytes;
+   if (--sp->frames > 0) return;
+   if (sp->gone) _spill_free(sp);
+   else _spill_empty(sp);
+}
+
+static Spillref
+_spill_ref(Termsaveframe *fr)
+{
+   Spillref ref;
+
+   // only int aligned where it is
+   memcpy(&ref, _frame_data(fr), sizeof(Spillref));
+   return ref;
+}
+
+static char *
+_spill_data(Termsaveframe *fr)
+{
+   Spillref ref = _spill_ref(fr);
+
+   if (!ref.spill->map) return NULL;
+   return ref.spill->map + ref.pos;
+}
+
+static int
+_save_size(const Termsave *ts)
+{
+   const Termsaveframe *fr = (const Termsaveframe *)ts;
+
+   // what _mem_new() was asked for when ts was made
+   if (ts->disk) return _frame_size(fr->num, sizeof(Spillref));
+   if (ts->z) return _frame_size(fr->num, fr->w);
+   return sizeof(Termsave) + ((ts->w - 1) * sizeof(Termcell));
+}
+
+// moves the data of fr to the file of ty
+static Eina_Bool
+_spill_frame(Termpty *ty, Termsaveframe *fr)
 {
-   Alloc *al;
-   unsigned char *ptr;
-   int newsize, sz, i, firstnull = -1;
+   Termspill *sp = ty->spill;
+   Termsaveframe *fr2;
+   Spillref ref;
+   long long pos;
+   int k, slot;
 
-   // allocations sized up to nearest size alloc alignment
-   newsize = MEM_ALLOC_ALIGN * ((size + MEM_ALLOC_ALIGN - 1) / MEM_ALLOC_ALIGN);
-   for (i = 0; i < MEM_BLOCKS; i++)
+   pos = _spill_alloc(sp, fr->w);
+   if (pos < 0) return EINA_FALSE;
+   if (pwrite(sp->fd, _frame_data(fr), fr->w, pos) != (ssize_t)fr->w)
      {
-        if (!alloc[i])
-          {
-             if (firstnull < 0) firstnull = i;
-             continue;
-          }
-        // if generation count matches
-        if (alloc[i]->gen == gen)
+        ERR("cannot write scrollback file: %s", strerror(errno));
+        sp->live[sp->seg] -= fr->w;
+        sp->broken = 1;
+        return EINA_FALSE;
+     }
+   fr2 = _mem_new(_frame_size(fr->num, sizeof(Spillref)));
+   if (!fr2)
+     {
+        sp->live[sp->seg] -= fr->w;
+        return EINA_FALSE;
+     }
+   memcpy(fr2, fr, _frame_size(fr->num, 0));
+   fr2->disk = 1;
+   ref.spill = sp;
+   ref.pos = pos;
+   memcpy(_frame_data(fr2), &ref, sizeof(Spillref));
+   sp->frames++;
+   for (k = 0; k < fr->num; k++)
+     {
+        slot = (fr->first + k) % ty->backmax;
+        if (ty->back[slot] == (Termsave *)fr)
+          ty->back[slot] = (Termsave *)fr2;
+     }
+   _frame_forget(fr);
+   _mem_free(fr, _frame_size(fr->num, fr->w));
+   return EINA_TRUE;
+}
+
+//// frame cache
+//
+// scrollback is read a row at a time (drawing, selections, rewrapping) and
+// rows next to each other share a frame, so the last FRAME_CACHE frames
+// read are kept decompressed. reading never touches back[], the frames stay
+// compressed where they are. rows handed out stay valid until FRAME_CACHE
+// other frames have been read or the frame goes away, so callers hold on to
+// a few rows at most and only while frozen.
+
+#define FRAME_CACHE 8
+
+typedef struct _Framecache Framecache;
+
+struct _Framecache
+{
+   Termsaveframe *frame;
+   Termcell      *cells;
+   int            max;
+   unsigned int   used; // frame_clock when last read
+};
+
+static Framecache frame_cache[FRAME_CACHE];
+static unsigned int frame_clock = 0;
+
+// decompresses the lz4 data buf of fr into cells, which has room for
+// fr->wout of them. touches nothing else so it runs in any thread
+static void
+_frame_unpack(const Termsaveframe *fr, const char *buf, Termcell *cells)
+{
+   unsigned int *packed;
+   int bytes = -1;
+
+   if (fr->pal)
+     {
+        packed = malloc((fr->wout + 1) * sizeof(unsigned int));
+        if (packed)
+          bytes = LZ4_uncompress(buf, (char *)packed,
+                                 fr->wout * sizeof(unsigned int));
+        if ((bytes >= 0) && (fr->attpal))
+          _attpal_cells_unpack(fr->attpal, packed, cells, fr->wout);
+        else bytes = -1;
+        free(packed);
+     }
+   else
+     bytes = LZ4_uncompress(buf, (char *)cells, fr->wout * sizeof(Termcell));
+   if (bytes < 0)
+     {
+        memset(cells, 0, fr->wout * sizeof(Termcell));
+//        ERR("Decompress problem in frame at byte %i", -bytes);
+     }
+}
+
+static Termcell *
+_frame_cells(Termsaveframe *fr)
+{
+   Framecache *fc = NULL;
+   Termcell *tmp;
+   char *buf;
+   int i;
+
+   for (i = 0; i < FRAME_CACHE; i++)
+     {
+        if (frame_cache[i].frame == fr)
           {
-             // if there is space in the block
-             if ((alloc[i]->size - alloc[i]->last) >= newsize)
-               {
-                  ptr = (unsigned char *)alloc[i];
-                  ptr += alloc[i]->last;
-                  alloc[i]->last += newsize;
-                  alloc[i]->count++;
-                  return ptr;
-               }
+             frame_cache[i].used = ++frame_clock;
+             return frame_cache[i].cells;
           }
+        // an empty entry, else the one read longest ago
+        if ((!fc) || ((fc->frame) &&
+                      ((!frame_cache[i].frame) ||
+                       ((frame_clock - frame_cache[i].used) >
+                        (frame_clock - fc->used)))))
+          fc = &(frame_cache[i]);
+     }
+   fc->frame = NULL;
+   buf = fr->disk ? _spill_data(fr) : _frame_data(fr);
+   if (!buf) return NULL;
+   if (fc->max < (int)(fr->wout + 1))
+     {
+        tmp = realloc(fc->cells, (fr->wout + 1) * sizeof(Termcell));
+        if (!tmp) return NULL;
+        fc->cells = tmp;
+        fc->max = fr->wout + 1;
      }
-   // out of slots for new blocks - no null blocks
-   if (firstnull < 0) return NULL;
+   _frame_unpack(fr, buf, fc->cells);
+   fc->frame = fr;
+   fc->used = ++frame_clock;
+   return fc->cells;
+}
 
-   // so allocate a new block
-   size = MEM_BLOCK_PAGES * MEM_PAGE_SIZE;
-   // size up to page size
-   sz = MEM_PAGE_SIZE * ((size + MEM_PAGE_SIZE - 1) / MEM_PAGE_SIZE);
-   // get mmaped anonymous memory so when freed it goes away from the system
-   ptr = mmap(NULL, sz, PROT_READ | PROT_WRITE,
-              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-   if (ptr == MAP_FAILED) return NULL;
+// fr is about to be freed or moved
+static void
+_frame_forget(Termsaveframe *fr)
+{
+   int i;
 
-   // note - we SHOULD memset to 0, but we are assuming mmap anon give 0 pages
-   //memset(ptr, 0, newsize);
-
-   al = (Alloc *)ptr;
-   al->size = sz;
-   al->last = sizeof(Alloc) + newsize;
-   al->count = 1;
-   al->slot = firstnull;
-   al->gen = gen;
-   alloc[al->slot] = al;
-   ptr = (unsigned char *)al;
-   ptr += sizeof(Alloc);
-   return ptr;
+   for (i = 0; i < FRAME_CACHE; i++)
+     {
+        if (frame_cache[i].frame == fr) frame_cache[i].frame = NULL;
+     }
 }
 
 static void
-_alloc_free(Alloc *al)
+_frame_cache_free(void)
 {
-   al->count--;
-   if (al->count > 0) return;
-   alloc[al->slot] = NULL;
-   munmap(al, al->size);
+   int i;
+
+   for (i = 0; i < FRAME_CACHE; i++)
+     {
+        free(frame_cache[i].cells);
+        frame_cache[i].frame = NULL;
+        frame_cache[i].cells = NULL;
+        frame_cache[i].max = 0;
+     }
 }
 
-static Alloc *
-_alloc_find(void *mem)
+//// snapshots
+//
+// a copy of a range of rows for reading them outside the mainloop, say to
+// export them from a thread. frames are copied still compressed, spilled
+// ones read back from the file, and only lines not in a frame yet and the
+// screen are copied as cells, so a snapshot of all the scrollback costs
+// about what the scrollback does. making and freeing one is for the
+// mainloop (the palette references), reading it for one thread at a time.
+
+typedef struct _Snaprow Snaprow;
+
+struct _Snaprow
 {
-   unsigned char *memptr = mem;
-   int i;
-   
-   for (i = 0; i < MEM_BLOCKS; i++)
+   int frame; // index in frames, -1 if the cells are at off in cells
+   int i; // line of the frame, or width of the cells
+   size_t off;
+};
+
+struct _Termsavesnap
+{
+   Snaprow *rows;
+   int num;
+   Termsaveframe **frames; // copies with the data in them, never on disk
+   int frames_num, frames_max;
+   Termcell *cells;
+   size_t cells_num, cells_max;
+   // the frame decompressed last, only touched by the reader
+   int cur;
+   Termcell *cur_cells;
+   int cur_max;
+};
+
+static Eina_Bool
+_snap_cells_add(Termsavesnap *sn, Snaprow *row, const Termcell *cells, int w)
+{
+   row->frame = -1;
+   row->i = w;
+   row->off = sn->cells_num;
+   if ((sn->cells_num + w) > sn->cells_max)
+     {
+        size_t max = MAX(sn->cells_max * 2, sn->cells_num + w + 1024);
+        Termcell *tmp = realloc(sn->cells, max * sizeof(Termcell));
+
+        if (!tmp) return EINA_FALSE;
+        sn->cells = tmp;
+        sn->cells_max = max;
+     }
+   if (w > 0) memcpy(sn->cells + sn->cells_num, cells, w * sizeof(Termcell));
+   sn->cells_num += w;
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_snap_frame_add(Termsavesnap *sn, Termsaveframe *fr)
+{
+   Termsaveframe *fr2;
+   const char *buf;
+
+   if (sn->frames_num == sn->frames_max)
+     {
+        Termsaveframe **tmp = realloc(sn->frames, (sn->frames_max + 64) *
+                                      sizeof(Termsaveframe *));
+
+        if (!tmp) return EINA_FALSE;
+        sn->frames = tmp;
+        sn->frames_max += 64;
+     }
+   buf = fr->disk ? _spill_data(fr) : _frame_data(fr);
+   fr2 = malloc(_frame_size(fr->num, fr->w));
+   if (!fr2) return EINA_FALSE;
+   memcpy(fr2, fr, _frame_size(fr->num, 0));
+   // a file that can't be read back reads as blank lines, like it does
+   // when drawn
+   if (buf) memcpy(_frame_data(fr2), buf, fr->w);
+   else fr2->w = 0;
+   fr2->disk = 0;
+   if (fr2->pal) _attpal_ref(fr2->attpal);
+   sn->frames[sn->frames_num++] = fr2;
+   return EINA_TRUE;
+}
+
+// rows y1 to y2 of ty as they are now, see termpty_cellrow_get() for what
+// the y's are
+Termsavesnap *
+termpty_save_snap_new(Termpty *ty, int y1, int y2)
+{
+   Termsavesnap *sn;
+   Termsaveframe *fr, *last = NULL;
+   Termcell *cells;
+   Snaprow *row;
+   int y, slot, w;
+
+   sn = calloc(1, sizeof(Termsavesnap));
+   if (!sn) return NULL;
+   sn->cur = -1;
+   sn->num = MAX(y2 - y1 + 1, 0);
+   sn->rows = calloc(sn->num + 1, sizeof(Snaprow));
+   if (!sn->rows) goto err;
+   for (y = y1; y <= y2; y++)
      {
-        unsigned char *ptr;
-        
-        ptr = (unsigned char *)alloc[i];
-        if (!ptr) continue;
-        if (memptr < ptr) continue;
-        if ((memptr - ptr) > 0x0fffffff) continue;
-        if (((size_t)memptr - (size_t)ptr) < (size_t)(alloc[i]->size))
-          return alloc[i];
+        row = &(sn->rows[y - y1]);
+        row->frame = -1;
+        if ((y < 0) && (y >= -ty->backmax) && (ty->back))
+          {
+             slot = (ty->backmax + ty->backpos + y) % ty->backmax;
+             fr = (Termsaveframe *)ty->back[slot];
+             if ((fr) && (fr->z))
+               {
+                  // the lines of a frame are in consecutive slots
+                  if ((fr != last) && (!_snap_frame_add(sn, fr))) goto err;
+                  last = fr;
+                  row->frame = sn->frames_num - 1;
+                  row->i = (slot - fr->first + ty->backmax) % ty->backmax;
+                  continue;
+               }
+          }
+        w = 0;
+        cells = termpty_cellrow_get(ty, y, &w);
+        if (!cells) w = 0;
+        if (!_snap_cells_add(sn, row, cells, w)) goto err;
      }
+   return sn;
+err:
+   termpty_save_snap_free(sn);
    return NULL;
 }
 
-static void *
-_mem_new(int size)
+// row y of the snapshot, 0 being the y1 it was made with. it stays valid
+// until the next call
+Termcell *
+termpty_save_snap_row_get(Termsavesnap *sn, int y, int *wret)
 {
-   void *ptr;
-   
-   if (!size) return NULL;
-   ptr = _alloc_new(size, cur_gen);
-   return ptr;
+   Termsaveframe *fr;
+   Snaprow *row;
+
+   if ((y < 0) || (y >= sn->num)) return NULL;
+   row = &(sn->rows[y]);
+   if (row->frame < 0)
+     {
+        *wret = row->i;
+        return sn->cells + row->off;
+     }
+   fr = sn->frames[row->frame];
+   if (sn->cur != row->frame)
+     {
+        // frames are read one after the other, so one at a time will do
+        if (sn->cur_max < (int)(fr->wout + 1))
+          {
+             Termcell *tmp = realloc(sn->cur_cells,
+                                     (fr->wout + 1) * sizeof(Termcell));
+
+             if (!tmp) return NULL;
+             sn->cur_cells = tmp;
+             sn->cur_max = fr->wout + 1;
+          }
+        if (fr->w > 0) _frame_unpack(fr, _frame_data(fr), sn->cur_cells);
+        else memset(sn->cur_cells, 0, fr->wout * sizeof(Termcell));
+        sn->cur = row->frame;
+     }
+   *wret = fr->off[row->i + 1] - fr->off[row->i];
+   return sn->cur_cells + fr->off[row->i];
 }
 
-static void
-_mem_free(void *ptr)
+void
+termpty_save_snap_free(Termsavesnap *sn)
 {
-   Alloc *al;
-   
-   if (!ptr) return;
-   al = _alloc_find(ptr);
-   if (!al)
+   int i;
+
+   if (!sn) return;
+   for (i = 0; i < sn->frames_num; i++)
      {
-        ERR("Cannot find %p in alloc blocks", ptr);
-        return;
+        if (sn->frames[i]->pal) _attpal_unref(sn->frames[i]->attpal);
+        free(sn->frames[i]);
      }
-   _alloc_free(al);
+   free(sn->frames);
+   free(sn->rows);
+   free(sn->cells);
+   free(sn->cur_cells);
+   free(sn);
+}
+
+//// defrag
+//
+// blocks are bump allocated and only go back to the system once the last
+// allocation in them is freed. lines that got decompressed or scrolled out
+// leave holes, so a block can end up holding a few lines and a lot of
+// nothing. every pass stops allocating from blocks that are mostly holes
+// and moves the compressed lines still in them elsewhere. only DEFRAG_LINES
+// back[] slots are looked at per pass, carrying on where the last pass
+// stopped, so a pass costs the same no matter how much scrollback there is.
+
+#define DEFRAG_LINES  4096 // back[] slots looked at per pass, over all ptys
+
+static Eina_Bool
+_alloc_holey(Alloc *al)
+{
+   return ((al->last - al->live) > (al->size / 2));
 }
 
 static void
-_mem_defrag(void)
+_defrag_pty(Termpty *ty, int budget)
 {
-   int i, j = 0;
-   Alloc *alloc2[MEM_BLOCKS];
-   
-   for (i = 0; i < MEM_BLOCKS; i++)
+   Termsave *ts, *ts2;
+   Termsaveframe *fr;
+   Alloc *al;
+   int i, k, n, slot, size;
+
+   if (!ty->back) return;
+   if (ty->comp.defrag >= ty->backmax) ty->comp.defrag = 0;
+   for (n = 0; (n < budget) && (n < ty->backmax); n++)
      {
-        if (alloc[i])
+        i = ty->comp.defrag;
+        ty->comp.defrag = (i + 1) % ty->backmax;
+        ts = ty->back[i];
+        // uncompressed lines leave by themselves once compressed
+        if ((!ts) || (!ts->z)) continue;
+        // like in _mem_free(), anything not in a block is left alone
+        al = _alloc_find(ts);
+        if ((!al) || (!_alloc_holey(al))) continue;
+        size = _save_size(ts);
+        ts2 = _mem_new(size);
+        if (!ts2) return;
+        memcpy(ts2, ts, size);
+        // all the slots still on the frame move with it
+        fr = (Termsaveframe *)ts;
+        for (k = 0; k < fr->num; k++)
           {
-//             printf("block %i @ %i [%i/%i] # %i\n", 
-//                    j, alloc[i]->gen, alloc[i]->last, alloc[i]->size, alloc[i]->count);
-             alloc2[j] = alloc[i];
-             alloc2[j]->slot = j;
-             j++;
+             slot = (fr->first + k) % ty->backmax;
+             if (ty->back[slot] == ts) ty->back[slot] = ts2;
           }
+        _frame_forget(fr);
+        _mem_free(ts, size);
      }
-   // XXX: quicksort blocks with most space at start
-   for (i = 0; i < j; i++) alloc[i] = alloc2[i];
-   for (; i < MEM_BLOCKS; i++) alloc[i] = NULL;
 }
 
 static void
-_mem_gen_next(void)
+_defrag_step(void)
 {
-   cur_gen++;
+   Eina_List *l;
+   Termpty *ty;
+   int i, holey = 0, budget;
+
+   for (i = 0; i < alloc_num; i++)
+     {
+        if ((!alloc[i]) || (!_alloc_holey(alloc[i]))) continue;
+        // no more allocations from it, it is only going to get emptier
+        alloc[i]->last = alloc[i]->size;
+        holey++;
+     }
+   if ((!holey) || (!ptys)) return;
+   budget = MAX(DEFRAG_LINES / (int)eina_list_count(ptys), 64);
+   EINA_LIST_FOREACH(ptys, l, ty) _defrag_pty(ty, budget);
 }
 
-static unsigned char
-_mem_gen_get(void)
+//// eviction
+//
+// all ptys share mem_budget bytes of scrollback. when a pass is done and
+// more than that is allocated the oldest lines go, whichever pty they are
+// in. it's only done then, so nobody can be holding on to a line that
+// goes. every EVICT_CHUNK lines a pty saves get a stamp from a clock all
+// ptys share, which tells how old the oldest line of each pty is. with the
+// disk store on, the oldest lines still in memory are spilled to disk
+// first and only lines that can't be get evicted.
+
+#define EVICT_CHUNK 64
+
+static unsigned long long save_clock = 0;
+
+static long long
+_evict_first(const Termpty *ty)
 {
-   return cur_gen;
+   // number of the oldest line left, counting all lines ever saved
+   return MAX((long long)ty->comp.lines - ty->backscroll_num, 0);
 }
 
-static int ts_comp = 0;
-static int ts_uncomp = 0;
-static int ts_freeops = 0;
-static int ts_compfreeze = 0;
-static int freeze = 0;
-static Eina_List *ptys = NULL;
-static Ecore_Idler *idler = NULL;
-static Ecore_Timer *timer = NULL;
+static unsigned long long
+_evict_age(const Termpty *ty, long long line)
+{
+   if (!ty->comp.stamps) return 0;
+   return ty->comp.stamps[(MAX(line, 0) / EVICT_CHUNK) %
+                          ty->comp.stamps_num];
+}
 
-static Termsave *
-_save_comp(Termsave *ts)
+static void
+_evict_pty(Termpty *ty)
 {
-   Termsave *ts2;
-   Termsavecomp *tsc;
+   int i, n, slot, first;
 
-   // already compacted
-   if (ts->comp) return ts;
-   // make new allocation for new generation
-   ts_compfreeze++;
-   if (!ts->z)
+   // up to the end of the oldest chunk, after that another pty may be older
+   n = EVICT_CHUNK - (_evict_first(ty) % EVICT_CHUNK);
+   n = MIN(n, ty->backscroll_num);
+   first = (ty->backpos - ty->backscroll_num + ty->backmax) % ty->backmax;
+   for (i = 0; i < n; i++)
      {
-        int bytes;
-        char *buf;
-        
-        buf = alloca(LZ4_compressBound(ts->w * sizeof(Termcell)));
-        bytes = LZ4_compress((char *)(&(ts->cell[0])), buf,
-                             ts->w * sizeof(Termcell));
-        tsc = _mem_new(sizeof(Termsavecomp) + bytes);
-        if (!tsc)
-          {
-             ERR("Big problem. Can't allocate backscroll compress buffer");
-             ts2 = ts;
-             goto done;
-          }
-        tsc->comp = 1;
-        tsc->z = 1;
-        tsc->gen = _mem_gen_get();
-        tsc->w = bytes;
-        tsc->wout = ts->w;
-        memcpy(((char *)tsc) + sizeof(Termsavecomp), buf, bytes);
-        ts2 = (Termsave *)tsc;
+        slot = (ty->backpos - ty->backscroll_num + ty->backmax) % ty->backmax;
+        termpty_save_free(ty->back[slot]);
+        ty->back[slot] = NULL;
+        ty->backscroll_num--;
      }
-   else
+   termpty_search_lines_gone(ty, first, n);
+   // in case it's scrolled back that far
+   termpty_dirty_all(ty);
+   if (ty->cb.change.func) ty->cb.change.func(ty->cb.change.data);
+}
+
+static long long
+_spill_first(const Termpty *ty)
+{
+   // number of the oldest line not looked at for spilling yet
+   return MAX(ty->comp.spilled,
+              (long long)ty->comp.lines - ty->backscroll_num);
+}
+
+static Eina_Bool
+_spill_can(const Termpty *ty)
+{
+   if ((!spill_on) || ((ty->spill) && (ty->spill->broken))) return EINA_FALSE;
+   return (_spill_first(ty) < (long long)ty->comp.lines);
+}
+
+// spills the frames of the oldest chunk not spilled yet
+static Eina_Bool
+_spill_pty(Termpty *ty)
+{
+   Termsave *ts;
+   long long first = _spill_first(ty), last;
+   int slot;
+
+   if (!ty->spill) ty->spill = _spill_new();
+   if ((!ty->spill) || (ty->spill->broken)) return EINA_FALSE;
+   last = first + EVICT_CHUNK - (((first % EVICT_CHUNK) + EVICT_CHUNK) %
+                                 EVICT_CHUNK);
+   last = MIN(last, (long long)ty->comp.lines);
+   for (; first < last; first++)
      {
-        ts2 = ts;
-        tsc = (Termsavecomp *)ts;
-        ts2 = _mem_new(sizeof(Termsavecomp) + tsc->w);
-        if (!ts2)
-          {
-             ERR("Big problem. Can't allocate backscroll compress/copy buffer");
-             ts2 = ts;
-             goto done;
-          }
-        memcpy(ts2, ts, sizeof(Termsavecomp) + tsc->w);
-        ts2->gen = _mem_gen_get();
-        ts2->comp = 1;
+        slot = (ty->backpos - (int)(ty->comp.lines - first) + ty->backmax) %
+          ty->backmax;
+        ts = ty->back[slot];
+        // the lines not compressed yet stay, they're too new to matter
+        if ((!ts) || (!ts->z) || (ts->disk)) continue;
+        if (!_spill_frame(ty, (Termsaveframe *)ts)) return EINA_FALSE;
      }
-   termpty_save_free(ts);
-done:
-   ts_compfreeze--;
-   return ts2;
+   ty->comp.spilled = last;
+   return EINA_TRUE;
 }
 
 static void
-_walk_pty(Termpty *ty)
+_mem_evict(void)
 {
-   int i;
-//   int c0 = 0, c1 = 0;
+   Eina_List *l;
+   Termpty *ty, *oldest, *spill;
+   unsigned long long age;
 
-   if (!ty->back) return;
-   for (i = 0; i < ty->backmax; i++)
+   while (mem_live > mem_budget)
      {
-        Termsavecomp *tsc = (Termsavecomp *)ty->back[i];
-
-        if (tsc)
+        // spilling anything beats evicting anything
+        oldest = spill = NULL;
+        EINA_LIST_FOREACH(ptys, l, ty)
           {
-             ty->back[i] = _save_comp(ty->back[i]);
-             tsc = (Termsavecomp *)ty->back[i];
-             if (tsc->comp) ts_comp++;
-             else ts_uncomp++;
-//             c0 += tsc->w;
-//             c1 += tsc->wout * sizeof(Termcell);
+             if ((!ty->reflow.src) &&
+                 ((!ty->back) || (ty->backscroll_num <= 0)))
+               continue;
+             if ((ty->back) && (ty->backscroll_num > 0) && (_spill_can(ty)))
+               {
+                  age = _evict_age(ty, _spill_first(ty));
+                  if ((!spill) || (age < _evict_age(spill, _spill_first(spill))))
+                    spill = ty;
+               }
+             // what's still to be rewrapped is older than all of back[],
+             // so the oldest rewrapped line's stamp is as old as it gets
+             if ((!oldest) ||
+                 (_evict_age(ty, _evict_first(ty)) <
+                  _evict_age(oldest, _evict_first(oldest))))
+               oldest = ty;
           }
+        if ((spill) && (_spill_pty(spill))) continue;
+        if (!oldest) break;
+        // and it goes before back[] does
+        if (oldest->reflow.src) _termpty_reflow_evict(oldest, EVICT_CHUNK);
+        else _evict_pty(oldest);
      }
-//   printf("compress ratio: %1.3f\n", (double)c0 / (double)c1);
 }
 
+static Eina_Bool _timer(void *data);
+
 static Eina_Bool
 _idler(void *data EINA_UNUSED)
 {
    Eina_List *l;
    Termpty *ty;
-//   double t0, t;
-   
-   _mem_gen_next();
+   Compqueue q = { NULL, NULL };
+   Eina_Bool held = EINA_FALSE;
 
-//   t0 = ecore_time_get();
-   // start afresh and count comp/uncomp;
-   ts_comp = 0;
-   ts_uncomp = 0;
    EINA_LIST_FOREACH(ptys, l, ty)
      {
-        _walk_pty(ty);
+        _walk_pty(ty, &q);
+        if (ty->comp.held) held = EINA_TRUE;
      }
-//   t = ecore_time_get();
-//   printf("comp/uncomp %i/%i time spent %1.5f\n", ts_comp, ts_uncomp, t - t0);
+   _comp_submit(&q);
+   // come back for lines held back even if nothing else needs a pass
+   if ((held) && (!timer)) timer = ecore_timer_add(0.2, _timer, NULL);
+   if (!comp_pending) _mem_evict();
+   _defrag_step();
    _mem_defrag();
    ts_freeops = 0;
-   
-   _mem_gen_next();
-   
+
    idler = NULL;
    return EINA_FALSE;
 }
@@ -297,12 +1579,14 @@ _timer(void *data EINA_UNUSED)
    return EINA_FALSE;
 }
 
-static inline void
+static void
 _check_compressor(Eina_Bool frozen)
 {
    if (freeze) return;
    if (idler) return;
-   if ((ts_uncomp > 256) || (ts_freeops > 256))
+   // the last pass is still being worked on
+   if (comp_pending > 0) return;
+   if ((ts_uncomp > 256) || (ts_freeops > 256) || (mem_live > mem_budget))
      {
         if (timer && !frozen) ecore_timer_reset(timer);
         else if (!timer) timer = ecore_timer_add(0.2, _timer, NULL);
@@ -312,8 +1596,8 @@ _check_compressor(Eina_Bool frozen)
 void
 termpty_save_freeze(void)
 {
-   // XXX: suspend compressor - this probably should be in a thread but right
-   // now it'll be fine here 
+   // XXX: suspend compressor. the worker keeps going but nothing it did
+   // gets applied until thawed
    if (!freeze++)
      {
         if (timer) ecore_timer_freeze(timer);
@@ -333,14 +1617,66 @@ termpty_save_thaw(void)
    if (freeze <= 0)
      {
         if (timer) ecore_timer_thaw(timer);
+        _comp_apply();
         _check_compressor(EINA_TRUE);
      }
 }
 
+void
+termpty_save_flush(void)
+{
+   // run a compressor pass now instead of waiting for the timer + idler,
+   // and wait for the worker to be done with it
+   if (freeze) return;
+   if (timer)
+     {
+        ecore_timer_del(timer);
+        timer = NULL;
+     }
+   if (idler)
+     {
+        ecore_idler_del(idler);
+        idler = NULL;
+     }
+   _comp_wait();
+   _idler(NULL);
+   _comp_wait();
+}
+
+void
+termpty_save_budget_set(size_t bytes)
+{
+   mem_budget = bytes;
+   _check_compressor(EINA_FALSE);
+}
+
+// memory kept for scrollback lines outside the blocks, like their search
+// signatures, so it counts against the budget too
+void
+termpty_save_mem_count(long bytes)
+{
+   mem_live += bytes;
+   if (bytes > 0) _check_compressor(EINA_FALSE);
+}
+
+void
+termpty_save_disk_set(Eina_Bool on)
+{
+   spill_on = on;
+}
+
+void
+termpty_save_stats_get(int *comp, int *uncomp)
+{
+   if (comp) *comp = ts_comp;
+   if (uncomp) *uncomp = ts_uncomp;
+}
+
 void
 termpty_save_register(Termpty *ty)
 {
    termpty_save_freeze();
+   if (!ptys) _comp_start();
    ptys = eina_list_append(ptys, ty);
    termpty_save_thaw();
 }
@@ -350,44 +1686,49 @@ termpty_save_unregister(Termpty *ty)
 {
    termpty_save_freeze();
    ptys = eina_list_remove(ptys, ty);
+   // no job may still point at ty or its palette once it's gone
+   _comp_purge(ty);
+   if (!ptys) _comp_stop();
+   // frames still packed with the palette keep it until they go
+   _attpal_unref(ty->attpal);
+   ty->attpal = NULL;
+   free(ty->comp.slots);
+   ty->comp.slots = NULL;
+   ty->comp.num = ty->comp.max = 0;
+   free(ty->comp.stamps);
+   ty->comp.stamps = NULL;
+   ty->comp.stamps_num = 0;
+   // its spilled frames are still around until back[] is freed
+   if (ty->spill)
+     {
+        if (ty->spill->frames > 0) ty->spill->gone = 1;
+        else _spill_free(ty->spill);
+        ty->spill = NULL;
+     }
+   if (!ptys) _frame_cache_free();
    termpty_save_thaw();
 }
 
-Termsave *
-termpty_save_extract(Termsave *ts)
+// ts is or was in back[slot], the slot tells which line of a frame it is
+Termcell *
+termpty_save_cells_get(Termpty *ty, Termsave *ts, int slot, int *wret)
 {
+   Termsaveframe *fr;
+   Termcell *cells;
+   int i;
+
    if (!ts) return NULL;
-   if (ts->z)
+   if (!ts->z)
      {
-        Termsavecomp *tsc = (Termsavecomp *)ts;
-        Termsave *ts2;
-        char *buf;
-        int bytes;
-        
-        ts2 = _mem_new(sizeof(Termsave) + ((tsc->wout - 1) * sizeof(Termcell)));
-        if (!ts2) return NULL;
-        ts2->gen = _mem_gen_get();
-        ts2->w = tsc->wout;
-        buf = ((char *)tsc) + sizeof(Termsavecomp);
-        bytes = LZ4_uncompress(buf, (char *)(&(ts2->cell[0])),
-                               tsc->wout * sizeof(Termcell));
-        if (bytes < 0)
-          {
-             memset(&(ts2->cell[0]), 0, tsc->wout * sizeof(Termcell));
-//             ERR("Decompress problem in row at byte %i", -bytes);
-          }
-        if (ts->comp) ts_comp--;
-        else ts_uncomp--;
-        ts_uncomp++;
-        ts_freeops++;
-        ts_compfreeze++;
-        _mem_free(ts);
-        ts_compfreeze--;
-        _check_compressor(EINA_FALSE);
-        return ts2;
+        *wret = ts->w;
+        return ts->cell;
      }
-   _check_compressor(EINA_FALSE);
-   return ts;
+   fr = (Termsaveframe *)ts;
+   i = (slot - fr->first + ty->backmax) % ty->backmax;
+   cells = _frame_cells(fr);
+   if (!cells) return NULL;
+   *wret = fr->off[i + 1] - fr->off[i];
+   return cells + fr->off[i];
 }
 
 Termsave *
@@ -395,7 +1736,6 @@ termpty_save_new(int w)
 {
    Termsave *ts = _mem_new(sizeof(Termsave) + ((w - 1) * sizeof(Termcell)));
    if (!ts) return NULL;
-   ts->gen = _mem_gen_get();
    ts->w = w;
    if (!ts_compfreeze) ts_uncomp++;
    _check_compressor(EINA_FALSE);
@@ -412,6 +1752,77 @@ termpty_save_free(Termsave *ts)
         else ts_uncomp--;
         ts_freeops++;
      }
-   _mem_free(ts);
+   if (ts->z)
+     {
+        Termsaveframe *fr = (Termsaveframe *)ts;
+
+        // it goes with the last line in it
+        if (--fr->refs > 0)
+          {
+             _check_compressor(EINA_FALSE);
+             return;
+          }
+        _frame_forget(fr);
+        if (fr->pal) _attpal_unref(fr->attpal);
+        if (fr->disk)
+          {
+             Spillref ref = _spill_ref(fr);
+
+             _spill_release(ref.spill, ref.pos, fr->w);
+          }
+     }
+   _mem_free(ts, _save_size(ts));
    _check_compressor(EINA_FALSE);
 }
+
+void
+termpty_save_added(Termpty *ty)
+{
+   int num = (ty->backmax / EVICT_CHUNK) + 2; // all chunks back[] can span
+
+   // the line just saved at backpos - 1, the ones before it are counted
+   if (ty->comp.saved < ty->backmax) ty->comp.saved++;
+   if (ty->comp.stamps_num != num)
+     {
+        free(ty->comp.stamps);
+        ty->comp.stamps = calloc(num, sizeof(unsigned long long));
+        ty->comp.stamps_num = ty->comp.stamps ? num : 0;
+        ty->comp.lines = 0;
+        ty->comp.spilled = LLONG_MIN;
+     }
+   save_clock++;
+   if ((ty->comp.stamps) && (!(ty->comp.lines % EVICT_CHUNK)))
+     ty->comp.stamps[(ty->comp.lines / EVICT_CHUNK) % ty->comp.stamps_num] =
+       save_clock;
+   ty->comp.lines++;
+}
+
+void
+termpty_save_changed(Termpty *ty, int slot)
+{
+   int *tmp;
+
+   termpty_search_changed(ty, slot);
+   // a rebuilt back[] holds nothing spilled anymore
+   if (slot < 0) ty->comp.spilled = LLONG_MIN;
+   if (ty->comp.all) return;
+   // a rebuilt back[], or so much of it changed that walking it is cheaper
+   if ((slot < 0) || (ty->comp.num >= (ty->backmax / 4)))
+     {
+        ty->comp.all = 1;
+        ty->comp.num = 0;
+        return;
+     }
+   if (ty->comp.num >= ty->comp.max)
+     {
+        tmp = realloc(ty->comp.slots, (ty->comp.max + 64) * sizeof(int));
+        if (!tmp)
+          {
+             ty->comp.all = 1;
+             return;
+          }
+        ty->comp.slots = tmp;
+        ty->comp.max += 64;
+     }
+   ty->comp.slots[ty->comp.num++] = slot;
+}
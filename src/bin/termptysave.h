@@ -2,7 +2,17 @@ void termpty_save_freeze(void);
 void termpty_save_thaw(void);
 void termpty_save_register(Termpty *ty);
 void termpty_save_unregister(Termpty *ty);
-Termsave *termpty_save_extract(Termsave *ts);
+Termcell *termpty_save_cells_get(Termpty *ty, Termsave *ts, int slot, int *wret);
 Termsave *termpty_save_new(int w);
 void termpty_save_free(Termsave *ts);
+void termpty_save_added(Termpty *ty);
+void termpty_save_changed(Termpty *ty, int slot);
+void termpty_save_flush(void);
+void termpty_save_budget_set(size_t bytes);
+void termpty_save_mem_count(long bytes);
+void termpty_save_disk_set(Eina_Bool on);
+void termpty_save_stats_get(int *comp, int *uncomp);
+Termsavesnap *termpty_save_snap_new(Termpty *ty, int y1, int y2);
+Termcell *termpty_save_snap_row_get(Termsavesnap *sn, int y, int *wret);
+void termpty_save_snap_free(Termsavesnap *sn);
     
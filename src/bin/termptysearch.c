@@ -0,0 +1,701 @@
+#include "private.h"
+#include <Elementary.h>
+#include <regex.h>
+#include <wctype.h>
+#include "termpty.h"
+#include "termptysave.h"
+#include "termptysearch.h"
+#include "utf8.h"
+
+#undef CRITICAL
+#undef ERR
+#undef WRN
+#undef INF
+#undef DBG
+
+#define CRITICAL(...) EINA_LOG_DOM_CRIT(_termpty_log_dom, __VA_ARGS__)
+#define ERR(...)      EINA_LOG_DOM_ERR(_termpty_log_dom, __VA_ARGS__)
+#define WRN(...)      EINA_LOG_DOM_WARN(_termpty_log_dom, __VA_ARGS__)
+#define INF(...)      EINA_LOG_DOM_INFO(_termpty_log_dom, __VA_ARGS__)
+#define DBG(...)      EINA_LOG_DOM_DBG(_termpty_log_dom, __VA_ARGS__)
+
+//// scrollback search
+//
+// every line saved to back[] gets a signature, a 256 bit bloom filter of
+// the (case folded) trigrams starting in it, including the ones that run on
+// into the next line if it wrapped. looking for some text only has to
+// decompress and go through the lines whose signatures have all of its
+// trigrams. when back[] is rebuilt (a resize rewraps it) the signatures
+// go, and are worked out again as searches come across the lines.
+//
+// they're kept in chunks of SIG_CHUNK back[] slots, made when a line in
+// them gets one and freed when its lines are all gone, and count as
+// scrollback memory.
+//
+// searches go through logical lines, rows wrapped into each other, and
+// number rows ty->search.lines + y so a match stays put while more lines
+// get saved
+
+#define SIG_VALID   (1ULL << 0) // the rest is worked out
+#define SIG_WRAPPED (1ULL << 1) // the line wrapped into the next one
+#define SIG_JOINED  (1ULL << 2) // and the trigrams across that are in too
+#define SIG_FLAGS   3
+#define SIG_BITS    (sizeof(Termsearchsig) * 8)
+
+// a line wrapping on and on is gone through this many rows at a time,
+// missing matches across the cuts
+#define SEARCH_LINE_ROWS 1024
+
+#define SIG_CHUNK 256 // signatures of this many back[] slots go together
+
+typedef struct _Sigfeed Sigfeed;
+
+// adds the trigrams of characters fed to it one at a time
+struct _Sigfeed
+{
+   Termsearchsig *sig;
+   Eina_Unicode last[2];
+   int n;
+};
+
+struct _Termsearch
+{
+   Termpty *ty;
+   Eina_Unicode *str; // what to look for, folded if case doesn't matter
+   int len;
+   regex_t re;
+   Termsearchsig sig; // trigrams a line needs to have str in it
+   // where the query was first looked for from, the match found last and
+   // the row the walk goes on from
+   long long origin_row, row, next;
+   int origin_x, x;
+   unsigned int gen;
+   // the logical line gone through last
+   struct {
+      Eina_Unicode *txt;
+      int *xs, *xe, *ys; // columns each character covers, and its row
+      char *utf8;
+      int *bo; // where each character starts in utf8
+      int num, max, umax;
+   } line;
+   Eina_Bool regex : 1;
+   Eina_Bool icase : 1;
+   Eina_Bool walking : 1;
+   Eina_Bool up : 1;
+   Eina_Bool fresh : 1; // next is in the middle of a line, find both ends
+};
+
+static inline Eina_Unicode
+_fold(Eina_Unicode g)
+{
+   if (g < 0x80)
+     return ((g >= 'A') && (g <= 'Z')) ? g + ('a' - 'A') : g;
+   return towlower(g);
+}
+
+static void
+_sig_feed(Sigfeed *f, Eina_Unicode g)
+{
+   unsigned int h;
+
+   g = _fold(g);
+   if (f->n == 2)
+     {
+        h = (f->last[0] * 0x9e3779b1U) ^ (f->last[1] * 0x85ebca77U) ^
+          (g * 0xc2b2ae3dU);
+        h ^= h >> 15;
+        h *= 0x2c1b3c6dU;
+        h ^= h >> 12;
+        h = SIG_FLAGS + (h % (SIG_BITS - SIG_FLAGS));
+        f->sig->bits[h / 64] |= 1ULL << (h % 64);
+     }
+   else
+     f->n++;
+   f->last[0] = f->last[1];
+   f->last[1] = g;
+}
+
+// rows as searches see them: a character per glyph, blanks as spaces
+static inline Eina_Bool
+_cell_skip(const Termcell *cell)
+{
+#if defined(SUPPORT_DBLWIDTH)
+   return (cell->codepoint == 0) && (cell->att.dblwidth);
+#else
+   return EINA_FALSE;
+#endif
+}
+
+static inline Eina_Unicode
+_cell_char(const Termcell *cell)
+{
+   return cell->codepoint ? (Eina_Unicode)cell->codepoint : ' ';
+}
+
+// the signature of back[] slot, if make is set one is made if need be
+static Termsearchsig *
+_sig_slot(Termpty *ty, int slot, Eina_Bool make)
+{
+   Termsearchsig **chunk;
+   int num = (ty->backmax + SIG_CHUNK - 1) / SIG_CHUNK;
+
+   if (!ty->search.sigs)
+     {
+        if ((!make) || (num <= 0)) return NULL;
+        ty->search.sigs = calloc(num, sizeof(Termsearchsig *));
+        if (!ty->search.sigs) return NULL;
+        ty->search.sigs_num = num;
+        termpty_save_mem_count(num * sizeof(Termsearchsig *));
+     }
+   chunk = &(ty->search.sigs[slot / SIG_CHUNK]);
+   if (!*chunk)
+     {
+        if (!make) return NULL;
+        *chunk = calloc(SIG_CHUNK, sizeof(Termsearchsig));
+        if (!*chunk) return NULL;
+        termpty_save_mem_count(SIG_CHUNK * sizeof(Termsearchsig));
+     }
+   return &((*chunk)[slot % SIG_CHUNK]);
+}
+
+static Termsearchsig *
+_sig_get(Termpty *ty, long long row, Eina_Bool make)
+{
+   long long y = row - ty->search.lines;
+
+   if ((ty->backmax <= 0) || (y >= 0) || (y < -ty->backscroll_num))
+     return NULL;
+   return _sig_slot(ty, (ty->backpos + (int)y + ty->backmax) % ty->backmax,
+                    make);
+}
+
+// whether any back[] slot chunk c has signatures for still has a line
+static Eina_Bool
+_sig_chunk_live(const Termpty *ty, int c)
+{
+   int first = (ty->backpos - ty->backscroll_num + ty->backmax) % ty->backmax;
+
+   if (ty->backscroll_num <= 0) return EINA_FALSE;
+   if (ty->backscroll_num >= ty->backmax) return EINA_TRUE;
+   // the lines are one run of slots, maybe wrapping around to 0, so they
+   // either start in the chunk or run into it from its first slot
+   if ((first >= c * SIG_CHUNK) && (first < (c + 1) * SIG_CHUNK))
+     return EINA_TRUE;
+   return ((c * SIG_CHUNK - first + ty->backmax) % ty->backmax) <
+     ty->backscroll_num;
+}
+
+// backmax may have changed already, so sigs_num says how many there are
+static void
+_sigs_free(Termpty *ty)
+{
+   int c, num = ty->search.sigs_num;
+
+   if (!ty->search.sigs) return;
+   for (c = 0; c < num; c++)
+     {
+        if (!ty->search.sigs[c]) continue;
+        free(ty->search.sigs[c]);
+        termpty_save_mem_count(-(long)(SIG_CHUNK * sizeof(Termsearchsig)));
+     }
+   free(ty->search.sigs);
+   termpty_save_mem_count(-(long)(num * sizeof(Termsearchsig *)));
+   ty->search.sigs = NULL;
+   ty->search.sigs_num = 0;
+}
+
+void
+termpty_search_line_add(Termpty *ty, int slot, const Termcell *cells, int w)
+{
+   Termsearchsig *sig, *prev;
+   Sigfeed f;
+   int x, n;
+
+   sig = _sig_slot(ty, slot, EINA_TRUE);
+   if (!sig) return;
+   memset(sig, 0, sizeof(Termsearchsig));
+   // the line before wrapped into this one, so the trigrams starting at
+   // its end run on into this one
+   prev = _sig_slot(ty, (slot + ty->backmax - 1) % ty->backmax, EINA_FALSE);
+   if ((prev) && (prev != sig) &&
+       ((prev->bits[0] & (SIG_VALID | SIG_WRAPPED | SIG_JOINED)) ==
+        (SIG_VALID | SIG_WRAPPED)))
+     {
+        f.sig = prev;
+        f.n = 0;
+        for (n = 0; n < ty->search.tailn; n++)
+          _sig_feed(&f, ty->search.tail[n]);
+        for (x = 0, n = 0; (x < w) && (n < 2); x++)
+          {
+             if (_cell_skip(&(cells[x]))) continue;
+             _sig_feed(&f, _cell_char(&(cells[x])));
+             n++;
+          }
+        prev->bits[0] |= SIG_JOINED;
+     }
+   f.sig = sig;
+   f.n = 0;
+   for (x = 0; x < w; x++)
+     {
+        if (_cell_skip(&(cells[x]))) continue;
+        _sig_feed(&f, _cell_char(&(cells[x])));
+     }
+   sig->bits[0] |= SIG_VALID;
+   if ((w > 0) && (cells[w - 1].att.autowrapped))
+     sig->bits[0] |= SIG_WRAPPED;
+   ty->search.tailn = f.n;
+   if (f.n == 2) ty->search.tail[0] = f.last[0];
+   if (f.n > 0) ty->search.tail[f.n - 1] = f.last[1];
+}
+
+void
+termpty_search_changed(Termpty *ty, int slot)
+{
+   Termsearchsig *sig;
+
+   if (slot < 0)
+     {
+        // back[] was rebuilt, and rows are numbered anew
+        _sigs_free(ty);
+        ty->search.tailn = 0;
+        ty->search.gen++;
+        return;
+     }
+   sig = _sig_slot(ty, slot, EINA_FALSE);
+   if (sig) memset(sig, 0, sizeof(Termsearchsig));
+}
+
+// the n oldest lines, from back[] slot on, went
+void
+termpty_search_lines_gone(Termpty *ty, int slot, int n)
+{
+   int c, i, num, chunks;
+
+   if ((!ty->search.sigs) || (n <= 0)) return;
+   num = ty->search.sigs_num;
+   chunks = MIN((((slot % SIG_CHUNK) + n - 1) / SIG_CHUNK) + 1, num);
+   for (i = 0, c = slot / SIG_CHUNK; i < chunks; i++, c = (c + 1) % num)
+     {
+        if ((!ty->search.sigs[c]) || (_sig_chunk_live(ty, c))) continue;
+        free(ty->search.sigs[c]);
+        ty->search.sigs[c] = NULL;
+        termpty_save_mem_count(-(long)(SIG_CHUNK * sizeof(Termsearchsig)));
+     }
+}
+
+Termsearch *
+termpty_search_new(Termpty *ty, int y, int x)
+{
+   Termsearch *se = calloc(1, sizeof(Termsearch));
+
+   if (!se) return NULL;
+   se->ty = ty;
+   se->origin_row = se->row = ty->search.lines + y;
+   se->origin_x = se->x = x;
+   se->gen = ty->search.gen;
+   return se;
+}
+
+static void
+_query_free(Termsearch *se)
+{
+   free(se->str);
+   se->str = NULL;
+   se->len = 0;
+   if (se->regex) regfree(&(se->re));
+   se->regex = EINA_FALSE;
+   memset(&(se->sig), 0, sizeof(Termsearchsig));
+}
+
+void
+termpty_search_free(Termsearch *se)
+{
+   if (!se) return;
+   _query_free(se);
+   free(se->line.txt);
+   free(se->line.xs);
+   free(se->line.xe);
+   free(se->line.ys);
+   free(se->line.utf8);
+   free(se->line.bo);
+   free(se);
+}
+
+Eina_Bool
+termpty_search_query_set(Termsearch *se, const char *str, Eina_Bool regex)
+{
+   Sigfeed f;
+   int i, len = 0;
+
+   _query_free(se);
+   se->row = se->origin_row;
+   se->x = se->origin_x;
+   se->walking = EINA_FALSE;
+   if ((!str) || (!str[0])) return EINA_FALSE;
+   se->str = eina_unicode_utf8_to_unicode(str, &len);
+   if (!se->str) return EINA_FALSE;
+   se->len = len;
+   // case only matters if there's an upper case letter in it
+   se->icase = EINA_TRUE;
+   for (i = 0; i < len; i++)
+     {
+        if (iswupper(se->str[i])) se->icase = EINA_FALSE;
+     }
+   if (regex)
+     {
+        int flags = REG_EXTENDED;
+
+        if (se->icase) flags |= REG_ICASE;
+        if (regcomp(&(se->re), str, flags) != 0)
+          {
+             DBG("bad regex '%s'", str);
+             _query_free(se);
+             return EINA_FALSE;
+          }
+        // what it matches can be anything, so no trigrams
+        se->regex = EINA_TRUE;
+        return EINA_TRUE;
+     }
+   f.sig = &(se->sig);
+   f.n = 0;
+   for (i = 0; i < len; i++)
+     {
+        _sig_feed(&f, se->str[i]);
+        if (se->icase) se->str[i] = _fold(se->str[i]);
+     }
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_row_wrapped(Termsearch *se, long long row)
+{
+   Termpty *ty = se->ty;
+   Termsearchsig *sig = _sig_get(ty, row, EINA_FALSE);
+   Termcell *cells;
+   int w = 0;
+
+   if ((sig) && (sig->bits[0] & SIG_VALID))
+     return !!(sig->bits[0] & SIG_WRAPPED);
+   cells = termpty_cellrow_get(ty, row - ty->search.lines, &w);
+   return (cells) && (w > 0) && (cells[w - 1].att.autowrapped);
+}
+
+// the signatures of rows top to bot say the query can't be in them
+static Eina_Bool
+_line_skip(Termsearch *se, long long top, long long bot)
+{
+   Termsearchsig all, *sig;
+   long long row;
+   unsigned int i;
+
+   if (se->regex) return EINA_FALSE;
+   memset(&all, 0, sizeof(all));
+   for (row = top; row <= bot; row++)
+     {
+        sig = _sig_get(se->ty, row, EINA_FALSE);
+        if ((!sig) || (!(sig->bits[0] & SIG_VALID))) return EINA_FALSE;
+        if ((row < bot) && (!(sig->bits[0] & SIG_JOINED))) return EINA_FALSE;
+        for (i = 0; i < EINA_C_ARRAY_LENGTH(all.bits); i++)
+          all.bits[i] |= sig->bits[i];
+     }
+   for (i = 0; i < EINA_C_ARRAY_LENGTH(all.bits); i++)
+     {
+        if ((all.bits[i] & se->sig.bits[i]) != se->sig.bits[i])
+          return EINA_TRUE;
+     }
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_line_grow(Termsearch *se, int n)
+{
+   Eina_Unicode *txt;
+   int *xs, *xe, *ys;
+
+   if (n <= se->line.max) return EINA_TRUE;
+   n = (n + 1023) & ~1023;
+   txt = realloc(se->line.txt, n * sizeof(Eina_Unicode));
+   if (txt) se->line.txt = txt;
+   xs = realloc(se->line.xs, n * sizeof(int));
+   if (xs) se->line.xs = xs;
+   xe = realloc(se->line.xe, n * sizeof(int));
+   if (xe) se->line.xe = xe;
+   ys = realloc(se->line.ys, n * sizeof(int));
+   if (ys) se->line.ys = ys;
+   if ((!txt) || (!xs) || (!xe) || (!ys)) return EINA_FALSE;
+   se->line.max = n;
+   return EINA_TRUE;
+}
+
+// signatures of the rows back[] lost them for, now their text is there
+static void
+_line_sigs_fix(Termsearch *se, long long top, long long bot)
+{
+   Termpty *ty = se->ty;
+   long long row;
+   int i = 0, j, e, n = se->line.num;
+
+   for (row = top; row <= bot; row++)
+     {
+        Termsearchsig *sig = _sig_get(ty, row, EINA_TRUE);
+        int r = row - top;
+        Sigfeed f;
+
+        while ((i < n) && (se->line.ys[i] < r)) i++;
+        if ((!sig) || (sig->bits[0] & SIG_VALID)) continue;
+        memset(sig, 0, sizeof(Termsearchsig));
+        f.sig = sig;
+        f.n = 0;
+        for (j = i; (j < n) && (se->line.ys[j] == r); j++)
+          _sig_feed(&f, se->line.txt[j]);
+        if (row < bot)
+          {
+             // and the trigrams running on into the next row
+             for (e = j; (j < n) && (j < e + 2); j++)
+               _sig_feed(&f, se->line.txt[j]);
+             sig->bits[0] |= SIG_WRAPPED | SIG_JOINED;
+          }
+        else if (_row_wrapped(se, row))
+          sig->bits[0] |= SIG_WRAPPED;
+        sig->bits[0] |= SIG_VALID;
+     }
+}
+
+// the text of rows top to bot, wrapped into each other
+static int
+_line_get(Termsearch *se, long long top, long long bot)
+{
+   Termpty *ty = se->ty;
+   long long row;
+   int n = 0, x;
+
+   for (row = top; row <= bot; row++)
+     {
+        Termcell *cells;
+        int w = 0;
+
+        cells = termpty_cellrow_get(ty, row - ty->search.lines, &w);
+        if (!cells) continue;
+        if (!_line_grow(se, n + w)) return -1;
+        for (x = 0; x < w; x++)
+          {
+             if (_cell_skip(&(cells[x])))
+               {
+                  if ((n > 0) && (se->line.ys[n - 1] == (row - top)))
+                    se->line.xe[n - 1] = x;
+                  continue;
+               }
+             se->line.txt[n] = _cell_char(&(cells[x]));
+             se->line.xs[n] = se->line.xe[n] = x;
+             se->line.ys[n] = row - top;
+             n++;
+          }
+     }
+   // the screen has blanks at the end of rows back[] doesn't keep
+   while ((n > 0) && (se->line.txt[n - 1] == ' ')) n--;
+   se->line.num = n;
+   _line_sigs_fix(se, top, bot);
+   return n;
+}
+
+static Eina_Bool
+_line_utf8_get(Termsearch *se)
+{
+   int i, b = 0, n = se->line.num;
+
+   if ((n * 6) + 8 > se->line.umax)
+     {
+        int max = (((n * 6) + 8) + 4095) & ~4095;
+        char *utf8;
+        int *bo;
+
+        utf8 = realloc(se->line.utf8, max);
+        if (utf8) se->line.utf8 = utf8;
+        bo = realloc(se->line.bo, ((max / 6) + 1) * sizeof(int));
+        if (bo) se->line.bo = bo;
+        if ((!utf8) || (!bo)) return EINA_FALSE;
+        se->line.umax = max;
+     }
+   for (i = 0; i < n; i++)
+     {
+        se->line.bo[i] = b;
+        b += codepoint_to_utf8(se->line.txt[i], se->line.utf8 + b);
+     }
+   se->line.bo[n] = b;
+   se->line.utf8[b] = 0;
+   return EINA_TRUE;
+}
+
+// the character starting at byte b of the utf8 text
+static int
+_line_char_at(Termsearch *se, int b)
+{
+   int lo = 0, hi = se->line.num;
+
+   while (lo < hi)
+     {
+        int mid = (lo + hi) / 2;
+
+        if (se->line.bo[mid] < b) lo = mid + 1;
+        else hi = mid;
+     }
+   return lo;
+}
+
+// the first match starting at character from or after it, or -1. endr
+// gets the character after it
+static int
+_line_match(Termsearch *se, int from, int *endr)
+{
+   int i, k, n = se->line.num;
+
+   if (se->regex)
+     {
+        regmatch_t pm;
+        int s, e, b;
+
+        while (from < n)
+          {
+             b = se->line.bo[from];
+             if (regexec(&(se->re), se->line.utf8 + b, 1, &pm,
+                         (from > 0) ? REG_NOTBOL : 0) != 0)
+               return -1;
+             s = _line_char_at(se, b + pm.rm_so);
+             e = _line_char_at(se, b + pm.rm_eo);
+             // empty matches don't count
+             if (e > s)
+               {
+                  *endr = e;
+                  return s;
+               }
+             from = s + 1;
+          }
+        return -1;
+     }
+   for (i = from; i + se->len <= n; i++)
+     {
+        for (k = 0; k < se->len; k++)
+          {
+             Eina_Unicode g = se->line.txt[i + k];
+
+             if (se->icase) g = _fold(g);
+             if (g != se->str[k]) break;
+          }
+        if (k == se->len)
+          {
+             *endr = i + se->len;
+             return i;
+          }
+     }
+   return -1;
+}
+
+// the match in the line closest to the last one in the direction gone in
+static int
+_line_search(Termsearch *se, long long top, int *endr)
+{
+   int s, e, from = 0, found = -1;
+
+   if ((se->regex) && (!_line_utf8_get(se))) return -1;
+   while ((s = _line_match(se, from, &e)) >= 0)
+     {
+        long long row = top + se->line.ys[s];
+        int x = se->line.xs[s];
+
+        if (se->up)
+          {
+             if ((row > se->row) || ((row == se->row) && (x >= se->x)))
+               break;
+             found = s;
+             *endr = e;
+          }
+        else if ((row > se->row) || ((row == se->row) && (x > se->x)))
+          {
+             found = s;
+             *endr = e;
+             break;
+          }
+        from = s + 1;
+     }
+   return found;
+}
+
+// looks for the next match up (older) or down from the last one, through
+// about rows rows of text. returns 1 with the match in x1r, y1r - x2r,
+// y2r, 0 if there's none or -1 if it has to be called again to go on
+int
+termpty_search_step(Termsearch *se, Eina_Bool up, int rows,
+                    int *x1r, int *y1r, int *x2r, int *y2r)
+{
+   Termpty *ty = se->ty;
+   long long first, last, top, bot;
+   int cost = 0, ret = -1, s = -1, e = 0;
+
+   if (!se->str) return 0;
+   if (se->gen != ty->search.gen)
+     {
+        // rows got numbered anew, so start over from the bottom
+        se->gen = ty->search.gen;
+        se->origin_row = se->row = ty->search.lines + ty->h - 1;
+        se->origin_x = se->x = ty->w;
+        se->walking = EINA_FALSE;
+     }
+   first = ty->search.lines - ty->backscroll_num;
+   last = ty->search.lines + ty->h - 1;
+   if ((!se->walking) || (se->up != up))
+     {
+        se->walking = EINA_TRUE;
+        se->fresh = EINA_TRUE;
+        se->up = up;
+        se->next = se->row;
+        if (se->next < first) se->next = first;
+        if (se->next > last) se->next = last;
+     }
+   termpty_cellcomp_freeze(ty);
+   // rows the signatures rule out cost next to nothing
+   while (cost < (rows * 16))
+     {
+        if ((se->next < first) || (se->next > last))
+          {
+             ret = 0;
+             break;
+          }
+        top = bot = se->next;
+        if ((up) || (se->fresh))
+          {
+             while ((top > first) && ((bot - top + 1) < SEARCH_LINE_ROWS) &&
+                    (_row_wrapped(se, top - 1)))
+               top--;
+          }
+        if ((!up) || (se->fresh))
+          {
+             while ((bot < last) && ((bot - top + 1) < SEARCH_LINE_ROWS) &&
+                    (_row_wrapped(se, bot)))
+               bot++;
+          }
+        se->fresh = EINA_FALSE;
+        se->next = up ? top - 1 : bot + 1;
+        cost += bot - top + 1;
+        if (_line_skip(se, top, bot)) continue;
+        cost += 16 * (bot - top + 1);
+        if (_line_get(se, top, bot) <= 0) continue;
+        s = _line_search(se, top, &e);
+        if (s >= 0)
+          {
+             ret = 1;
+             break;
+          }
+     }
+   if (ret > 0)
+     {
+        se->row = top + se->line.ys[s];
+        se->x = se->line.xs[s];
+        if (x1r) *x1r = se->x;
+        if (y1r) *y1r = se->row - ty->search.lines;
+        if (x2r) *x2r = se->line.xe[e - 1];
+        if (y2r) *y2r = top + se->line.ys[e - 1] - ty->search.lines;
+     }
+   termpty_cellcomp_thaw(ty);
+   if (ret >= 0) se->walking = EINA_FALSE;
+   return ret;
+}
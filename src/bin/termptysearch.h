@@ -0,0 +1,9 @@
+typedef struct _Termsearch Termsearch;
+
+Termsearch *termpty_search_new(Termpty *ty, int y, int x);
+void        termpty_search_free(Termsearch *se);
+Eina_Bool   termpty_search_query_set(Termsearch *se, const char *str, Eina_Bool regex);
+int         termpty_search_step(Termsearch *se, Eina_Bool up, int rows, int *x1r, int *y1r, int *x2r, int *y2r);
+void        termpty_search_line_add(Termpty *ty, int slot, const Termcell *cells, int w);
+void        termpty_search_changed(Termpty *ty, int slot);
+void        termpty_search_lines_gone(Termpty *ty, int slot, int n);
@@ -0,0 +1,36 @@
+#!/bin/sh
+# replay the recorded streams in this directory through tybench and compare
+# the dumped scrollback + screen with what they gave when recorded. every
+# stream is fed whole, a byte at a time and in 7 byte bits so sequences split
+# across reads get checked too.
+#
+# TYBENCH is the tybench binary, srcdir the directory with tests/ in it
+
+TYBENCH=${TYBENCH:-./tybench}
+srcdir=${srcdir:-.}
+out=tybench_check.$$
+ret=0
+
+while read name w h b; do
+   for chunk in 262144 7 1; do
+      if ! "$TYBENCH" -d -w $w -h $h -b $b -c $chunk \
+           "$srcdir/tests/$name.log" > $out 2> /dev/null; then
+         echo "FAIL: $name ${w}x$h -b $b -c $chunk: tybench failed"
+         ret=1
+      elif ! cmp -s $out "$srcdir/tests/$name-${w}x$h-$b.txt"; then
+         echo "FAIL: $name ${w}x$h -b $b -c $chunk: dump differs"
+         ret=1
+      fi
+   done
+done <<LIST
+cursor 80 24 500
+sgr 80 24 500
+string 80 24 500
+text 80 24 500
+text 40 10 50
+utf8 80 24 500
+utf8 40 10 50
+LIST
+
+rm -f $out
+exit $ret
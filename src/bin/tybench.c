@@ -0,0 +1,262 @@
+#include "private.h"
+#include <Elementary.h>
+#include "termpty.h"
+#include "termptyops.h"
+#include "termptysave.h"
+#include "termio.h"
+#include "utf8.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//// headless throughput benchmark for the termpty layer
+//
+// this links termpty.c, termptyesc.c, termptyops.c, termptysave.c and
+// friends without termio or any evas objects. recorded byte streams (log
+// files, captures of "script -q", etc.) are replayed through termpty_feed()
+// into a termpty_new_headless() pty, which is the same utf8 decode +
+// _handle_buf() path that _cb_fd_read() uses, just without the read(). the
+// termio callbacks the pty layer calls are stubbed out below and only count
+// what they are told.
+//
+// with -d the text of the scrollback and screen is dumped at the end, which
+// "make check" compares against what recorded streams should give
+
+int _log_domain = -1;
+
+static unsigned long long cells_written = 0;
+static unsigned long long lines_scrolled = 0;
+
+void
+termio_scroll(Evas_Object *obj EINA_UNUSED, int direction EINA_UNUSED,
+              int start_y EINA_UNUSED, int end_y EINA_UNUSED)
+{
+   lines_scrolled++;
+}
+
+void
+termio_content_change(Evas_Object *obj EINA_UNUSED,
+                      Evas_Coord x EINA_UNUSED, Evas_Coord y EINA_UNUSED,
+                      int n)
+{
+   cells_written += n;
+}
+
+Config *
+termio_config_get(const Evas_Object *obj EINA_UNUSED)
+{
+   return NULL;
+}
+
+Evas_Object *
+termio_win_get(Evas_Object *obj EINA_UNUSED)
+{
+   return NULL;
+}
+
+static char *
+_file_load(const char *file, size_t *size)
+{
+   FILE *f;
+   char *buf = NULL;
+   size_t alloced = 0, len = 0, n;
+
+   if (!strcmp(file, "-")) f = stdin;
+   else f = fopen(file, "rb");
+   if (!f)
+     {
+        perror(file);
+        return NULL;
+     }
+   for (;;)
+     {
+        if (len == alloced)
+          {
+             char *tmp;
+
+             alloced = alloced ? alloced * 2 : 1024 * 1024;
+             tmp = realloc(buf, alloced);
+             if (!tmp)
+               {
+                  free(buf);
+                  buf = NULL;
+                  break;
+               }
+             buf = tmp;
+          }
+        n = fread(buf + len, 1, alloced - len, f);
+        if (n == 0) break;
+        len += n;
+     }
+   if (f != stdin) fclose(f);
+   *size = len;
+   return buf;
+}
+
+static void
+_row_dump(const Termcell *cells, int w)
+{
+   char txt[8];
+   int x, len;
+
+   w = termpty_line_length(cells, w);
+   for (x = 0; x < w; x++)
+     {
+        int g = cells[x].codepoint;
+
+#if defined(SUPPORT_DBLWIDTH)
+        if ((g == 0) && (x > 0) && (cells[x - 1].att.dblwidth)) continue;
+#endif
+        if (g < ' ') g = ' ';
+        len = codepoint_to_utf8(g, txt);
+        if (len > 0) fwrite(txt, 1, len, stdout);
+     }
+   fputc('\n', stdout);
+}
+
+static void
+_pty_dump(Termpty *ty)
+{
+   Termcell *cells;
+   int y, w;
+
+   termpty_cellcomp_freeze(ty);
+   for (y = -ty->backscroll_num; y < ty->h; y++)
+     {
+        w = 0;
+        cells = termpty_cellrow_get(ty, y, &w);
+        if (cells) _row_dump(cells, w);
+        else fputc('\n', stdout);
+     }
+   termpty_cellcomp_thaw(ty);
+}
+
+static void
+_usage(const char *argv0)
+{
+   printf("Usage: %s [-w COLS] [-h ROWS] [-b LINES] [-n REPEAT] [-c BYTES] "
+          "[-C] [-d] FILE [FILE...]\n"
+          "  Replay recorded terminal output through the termpty parser and\n"
+          "  report throughput. FILE may be - for stdin.\n"
+          "  -w COLS    terminal width (default 80)\n"
+          "  -h ROWS    terminal height (default 24)\n"
+          "  -b LINES   scrollback size (default 2000)\n"
+          "  -n REPEAT  replay the input this many times (default 1)\n"
+          "  -c BYTES   feed it this many bytes at a time (default 262144)\n"
+          "  -C         never run the scrollback compressor\n"
+          "  -d         dump scrollback + screen text to stdout at the end\n"
+          "\n",
+          argv0);
+}
+
+int
+main(int argc, char **argv)
+{
+   Termpty *ty;
+   const char **files;
+   char *input = NULL;
+   size_t size = 0, off;
+   int i, nfiles = 0, w = 80, h = 24, backscroll = 2000, repeat = 1, r;
+   int chunk = 64 * 4096;
+   int comp0 = 0, uncomp0 = 0, comp1 = 0, uncomp1 = 0;
+   unsigned long long compressed = 0, total = 0;
+   Eina_Bool compress = EINA_TRUE, dump = EINA_FALSE;
+   double t, t_parse = 0.0, t_comp = 0.0, mb;
+
+   files = calloc(argc, sizeof(char *));
+   if (!files) return 1;
+   for (i = 1; i < argc; i++)
+     {
+        if ((!strcmp(argv[i], "-w")) && (i < (argc - 1))) w = atoi(argv[++i]);
+        else if ((!strcmp(argv[i], "-h")) && (i < (argc - 1))) h = atoi(argv[++i]);
+        else if ((!strcmp(argv[i], "-b")) && (i < (argc - 1))) backscroll = atoi(argv[++i]);
+        else if ((!strcmp(argv[i], "-n")) && (i < (argc - 1))) repeat = atoi(argv[++i]);
+        else if ((!strcmp(argv[i], "-c")) && (i < (argc - 1))) chunk = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-C")) compress = EINA_FALSE;
+        else if (!strcmp(argv[i], "-d")) dump = EINA_TRUE;
+        else if ((!strcmp(argv[i], "-help")) || (!strcmp(argv[i], "--help")))
+          {
+             _usage(argv[0]);
+             free(files);
+             return 0;
+          }
+        else files[nfiles++] = argv[i];
+     }
+   if ((nfiles == 0) || (w < 2) || (h < 1) || (backscroll < 0) ||
+       (repeat < 1) || (chunk < 1))
+     {
+        _usage(argv[0]);
+        free(files);
+        return 1;
+     }
+
+   eina_init();
+   ecore_init();
+   _log_domain = eina_log_domain_register("tybench", NULL);
+   termpty_init();
+
+   ty = termpty_new_headless(w, h, backscroll);
+   if (!ty)
+     {
+        fprintf(stderr, "cannot allocate %ix%i terminal\n", w, h);
+        free(files);
+        return 1;
+     }
+
+   for (i = 0; i < nfiles; i++)
+     {
+        input = _file_load(files[i], &size);
+        if (!input) continue;
+        for (r = 0; r < repeat; r++)
+          {
+             for (off = 0; off < size; off += chunk)
+               {
+                  int len = chunk;
+
+                  // a few _cb_fd_read() worth of data, then the idler gets
+                  // a go at compressing what scrolled off
+                  if ((off + len) > size) len = size - off;
+                  t = ecore_time_get();
+                  termpty_feed(ty, input + off, len);
+                  t_parse += ecore_time_get() - t;
+                  total += len;
+
+                  if (!compress) continue;
+                  termpty_save_stats_get(&comp0, &uncomp0);
+                  t = ecore_time_get();
+                  termpty_save_flush();
+                  t_comp += ecore_time_get() - t;
+                  termpty_save_stats_get(&comp1, &uncomp1);
+                  if (uncomp0 > uncomp1) compressed += uncomp0 - uncomp1;
+               }
+          }
+        free(input);
+     }
+
+   if (dump) _pty_dump(ty);
+
+   mb = (double)total / (1024.0 * 1024.0);
+   fprintf(stderr, "terminal:     %ix%i, %i lines scrollback\n",
+           w, h, backscroll);
+   fprintf(stderr, "input:        %1.2f MB in %1.3f s\n", mb, t_parse);
+   if (t_parse > 0.0)
+     {
+        fprintf(stderr, "throughput:   %1.2f MB/s\n", mb / t_parse);
+        fprintf(stderr, "cells:        %llu (%1.0f cells/s)\n",
+                cells_written, (double)cells_written / t_parse);
+        fprintf(stderr, "scrolled:     %llu lines (%1.0f lines/s)\n",
+                lines_scrolled, (double)lines_scrolled / t_parse);
+     }
+   if ((compress) && (t_comp > 0.0))
+     fprintf(stderr, "compressed:   %llu lines in %1.3f s (%1.0f lines/s)\n",
+             compressed, t_comp, (double)compressed / t_comp);
+
+   termpty_free(ty);
+   termpty_shutdown();
+   eina_log_domain_unregister(_log_domain);
+   _log_domain = -1;
+   ecore_shutdown();
+   eina_shutdown();
+   free(files);
+   return 0;
+}
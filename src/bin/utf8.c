@@ -1,5 +1,11 @@
 #include "utf8.h"
 
+#if defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
 int
 codepoint_to_utf8(int g, char *txt)
 {
@@ -60,3 +66,105 @@ codepoint_to_utf8(int g, char *txt)
         return 0;
      }
 }
+
+/* widen the run of printable ascii (0x20 - 0x7e) at the start of src into
+ * dst and return its length. stops at control chars (ESC included), DEL
+ * and anything with the high bit set. dst must have room for len entries
+ * as the vector paths may write a whole block past the end of the run */
+int
+ascii_printable_widen(const char *src, int len, unsigned int *dst)
+{
+   const unsigned char *s = (const unsigned char *)src;
+   int i = 0;
+
+   // b is printable if (signed char)(b + 1) > 0x20: 0x7f wraps to -128,
+   // 0x80-0xfe go negative, 0xff goes to 0, controls end up <= 0x20
+#if defined(__AVX2__)
+   const __m256i one = _mm256_set1_epi8(1), sp = _mm256_set1_epi8(0x20);
+
+   for (; i + 32 <= len; i += 32)
+     {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        unsigned int m;
+        int k;
+
+        m = _mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_add_epi8(v, one),
+                                                   sp));
+        for (k = 0; k < 32; k += 8)
+          _mm256_storeu_si256((__m256i *)(dst + i + k),
+                              _mm256_cvtepu8_epi32
+                              (_mm_loadl_epi64((const __m128i *)(s + i + k))));
+        if (m != 0xffffffff) return i + __builtin_ctz(~m);
+     }
+#elif defined(__SSE2__)
+   const __m128i one = _mm_set1_epi8(1), sp = _mm_set1_epi8(0x20);
+   const __m128i zero = _mm_setzero_si128();
+
+   for (; i + 16 <= len; i += 16)
+     {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+        unsigned int m;
+
+        m = _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_add_epi8(v, one), sp));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128((__m128i *)(dst + i + 4), _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128((__m128i *)(dst + i + 8), _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128((__m128i *)(dst + i + 12), _mm_unpackhi_epi16(hi, zero));
+        if (m != 0xffff) return i + __builtin_ctz(~m);
+     }
+#endif
+   for (; i < len; i++)
+     {
+        if ((s[i] < 0x20) || (s[i] >= 0x7f)) break;
+        dst[i] = s[i];
+     }
+   return i;
+}
+
+/* length of the run of codepoints at c that are neither control chars
+ * (< 0x20) nor DEL - i.e. what the escape parser hands on as plain text */
+int
+codepoint_printable_run(const unsigned int *c, int len)
+{
+   int i = 0;
+
+   // codepoints are unsigned, so flip the sign bit to compare with the
+   // signed compare instructions
+#if defined(__AVX2__)
+   const __m256i bias = _mm256_set1_epi32(0x80000000);
+   const __m256i sp = _mm256_set1_epi32(0x80000000 | 0x20);
+   const __m256i del = _mm256_set1_epi32(0x7f);
+
+   for (; i + 8 <= len; i += 8)
+     {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(c + i));
+        unsigned int m;
+
+        m = _mm256_movemask_epi8
+          (_mm256_or_si256(_mm256_cmpgt_epi32(sp, _mm256_xor_si256(v, bias)),
+                           _mm256_cmpeq_epi32(v, del)));
+        if (m) return i + (__builtin_ctz(m) / 4);
+     }
+#elif defined(__SSE2__)
+   const __m128i bias = _mm_set1_epi32(0x80000000);
+   const __m128i sp = _mm_set1_epi32(0x80000000 | 0x20);
+   const __m128i del = _mm_set1_epi32(0x7f);
+
+   for (; i + 4 <= len; i += 4)
+     {
+        __m128i v = _mm_loadu_si128((const __m128i *)(c + i));
+        unsigned int m;
+
+        m = _mm_movemask_epi8
+          (_mm_or_si128(_mm_cmplt_epi32(_mm_xor_si128(v, bias), sp),
+                        _mm_cmpeq_epi32(v, del)));
+        if (m) return i + (__builtin_ctz(m) / 4);
+     }
+#endif
+   for (; i < len; i++)
+     {
+        if ((c[i] < 0x20) || (c[i] == 0x7f)) break;
+     }
+   return i;
+}
@@ -1,2 +1,4 @@
 int codepoint_to_utf8(int g, char *txt);
+int ascii_printable_widen(const char *src, int len, unsigned int *dst);
+int codepoint_printable_run(const unsigned int *c, int len);
     